@@ -0,0 +1,484 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - batch mode for the utilities */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#if !defined(__WIN32__)
+#include <unistd.h>
+#endif
+#include "dkcomp.h"
+#include "batch_util.h"
+
+/* manifests commonly refer to the same ROM over and over, */
+/* so each input file is read once and shared by its jobs  */
+struct INPUT {
+    char *name;
+    pthread_mutex_t lock;
+    unsigned char *data;
+    size_t size;
+    int loaded;
+    int error;
+    unsigned users; /* jobs that haven't finished with it yet */
+};
+
+struct BATCH {
+    struct BATCH_JOB *jobs;
+    struct INPUT    **job_input; /* one for each job */
+    size_t job_count;
+    struct INPUT *inputs;
+    size_t input_count;
+    char **lines;                /* (the manifest, which jobs point into) */
+    size_t next;                 /* next job to hand out */
+    pthread_mutex_t lock;
+    BATCH_FUNC run;
+
+    /* finished jobs waiting to be checked, in the order they finished */
+    BATCH_FUNC check;
+    size_t *queue;
+    size_t queued, checked;
+    size_t retired;              /* jobs the workers are done with */
+    pthread_cond_t ready;
+};
+
+static double now (void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int batch_read (const char *name, unsigned char **data, size_t *size) {
+    FILE *f = fopen(name, "rb");
+    long len;
+    if (f == NULL)
+        return DK_ERROR_FILE_INPUT;
+    if (fseek(f, 0, SEEK_END) == -1
+    || (len = ftell(f)) == -1
+    ||  fseek(f, 0, SEEK_SET) == -1) {
+        fclose(f);
+        return DK_ERROR_SEEK_INPUT;
+    }
+    if ((*data = malloc(len ? len : 1)) == NULL) {
+        fclose(f);
+        return DK_ERROR_ALLOC;
+    }
+    if (fread(*data, 1, len, f) != (size_t)len) {
+        fclose(f);
+        free(*data);
+        *data = NULL;
+        return DK_ERROR_FREAD;
+    }
+    fclose(f);
+    *size = len;
+    return 0;
+}
+
+int batch_write (const char *name, unsigned char *data, size_t size) {
+    FILE *f = fopen(name, "wb");
+    if (f == NULL)
+        return DK_ERROR_FILE_OUTPUT;
+    if (fwrite(data, 1, size, f) != size) {
+        fclose(f);
+        return DK_ERROR_FWRITE;
+    }
+    fclose(f);
+    return 0;
+}
+
+void batch_stats (const struct DK_STATS *stats) {
+    static const char *phases[DK_PHASE_LIMIT] = {
+        [DK_PHASE_SETUP  ] = "setup",
+        [DK_PHASE_SEARCH ] = "search",
+        [DK_PHASE_REVERSE] = "reverse",
+        [DK_PHASE_EMIT   ] = "emit"
+    };
+    int i;
+    if (!stats->collected) {
+        puts("No statistics, the library was built without DKCOMP_STATS.");
+        return;
+    }
+    puts("\nCase      Count       Bytes");
+    for (i = 0; i < DK_STATS_CASES; i++)
+        if (stats->cases[i].count)
+            printf("  %2d %10zu  %10zu\n", i, stats->cases[i].count, stats->cases[i].bytes);
+    printf("\nProbes      %10zu\n"
+           "Relaxations %10zu\n"
+           "Slow path   %10zu\n\n", stats->probes, stats->relaxations, stats->slow);
+    for (i = 0; i < DK_PHASE_LIMIT; i++)
+        printf("%-8s %10.6fs\n", phases[i], stats->seconds[i]);
+}
+
+
+
+/* manifest parsing */
+
+static void free_batch (struct BATCH *b) {
+    size_t i;
+    for (i = 0; i < b->input_count; i++) {
+        pthread_mutex_destroy(&b->inputs[i].lock);
+        free(b->inputs[i].data);
+    }
+    for (i = 0; i < b->job_count; i++)
+        free(b->lines[i]);
+    free(b->inputs);
+    free(b->job_input);
+    free(b->jobs);
+    free(b->lines);
+    free(b->queue);
+}
+
+/* split off the next tab separated field */
+static char *next_field (char **s) {
+    char *field = *s, *tab;
+    if (field == NULL)
+        return NULL;
+    if ((tab = strchr(field, '\t')) != NULL) {
+        *tab = 0;
+        *s = tab + 1;
+    }
+    else {
+        *s = NULL;
+    }
+    return field;
+}
+
+static int parse_line (struct BATCH_JOB *job, char *s, int positions, int formats) {
+    char *format, *output, *input, *offset = NULL, *end;
+    format = next_field(&s);
+    output = next_field(&s);
+    input  = next_field(&s);
+    if (positions)
+        offset = next_field(&s);
+    if (input == NULL || !*output || !*input
+    || (positions && offset == NULL) || s != NULL)
+        return 1;
+
+    job->format = strtol(format, &end, 0);
+    if (end == format || *end || job->format < 0 || job->format >= formats)
+        return 1;
+    job->output = output;
+    job->input  = input;
+    if (positions) {
+        job->offset = strtoul(offset, &end, 0);
+        if (end == offset || *end)
+            return 1;
+    }
+    return 0;
+}
+
+static int read_manifest (struct BATCH *b, FILE *f, int positions, int formats) {
+    char buf[4096];
+    size_t capacity = 0, line = 0;
+
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        size_t len = strlen(buf);
+        line++;
+        if (len && buf[len-1] == '\n') buf[--len] = 0;
+        if (len && buf[len-1] == '\r') buf[--len] = 0;
+        if (!len || *buf == '#')
+            continue;
+
+        if (b->job_count == capacity) {
+            struct BATCH_JOB *jobs;
+            char **lines;
+            capacity = capacity ? capacity * 2 : 64;
+            if ((jobs  = realloc(b->jobs,  capacity * sizeof(struct BATCH_JOB))) != NULL)
+                b->jobs = jobs;
+            if ((lines = realloc(b->lines, capacity * sizeof(char*))) != NULL)
+                b->lines = lines;
+            if (jobs == NULL || lines == NULL) {
+                fprintf(stderr, "Failed to allocate memory for the manifest.\n");
+                return 1;
+            }
+        }
+        if ((b->lines[b->job_count] = malloc(len + 1)) == NULL) {
+            fprintf(stderr, "Failed to allocate memory for the manifest.\n");
+            return 1;
+        }
+        memcpy(b->lines[b->job_count], buf, len + 1);
+        memset(&b->jobs[b->job_count], 0, sizeof(struct BATCH_JOB));
+        if (parse_line(&b->jobs[b->job_count], b->lines[b->job_count], positions, formats)) {
+            free(b->lines[b->job_count]);
+            fprintf(stderr, "Invalid manifest entry on line %zu.\n", line);
+            return 1;
+        }
+        b->job_count++;
+    }
+    if (ferror(f)) {
+        fprintf(stderr, "Failed to read the manifest.\n");
+        return 1;
+    }
+    return 0;
+}
+
+static size_t hash_name (const char *s) {
+    size_t h = 5381;
+    while (*s)
+        h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+/* match each job up with its (possibly shared) input file */
+static int find_inputs (struct BATCH *b) {
+    struct INPUT **table;
+    size_t size = 1, i;
+
+    while (size < b->job_count * 2)
+        size *= 2;
+    table       = calloc(size, sizeof(struct INPUT*));
+    b->inputs   = calloc(b->job_count ? b->job_count : 1, sizeof(struct INPUT));
+    b->job_input = malloc((b->job_count ? b->job_count : 1) * sizeof(struct INPUT*));
+    if (table == NULL || b->inputs == NULL || b->job_input == NULL) {
+        free(table);
+        fprintf(stderr, "Failed to allocate memory for the manifest.\n");
+        return 1;
+    }
+
+    for (i = 0; i < b->job_count; i++) {
+        const char *name = b->jobs[i].input;
+        size_t h = hash_name(name) & (size-1);
+        while (table[h] != NULL && strcmp(table[h]->name, name))
+            h = (h + 1) & (size-1);
+        if (table[h] == NULL) {
+            table[h] = &b->inputs[b->input_count++];
+            table[h]->name = (char*)name;
+            pthread_mutex_init(&table[h]->lock, NULL);
+        }
+        table[h]->users++;
+        b->job_input[i] = table[h];
+    }
+    free(table);
+    return 0;
+}
+
+
+
+/* running jobs */
+
+static int acquire_input (struct INPUT *in, struct BATCH_JOB *job) {
+    pthread_mutex_lock(&in->lock);
+    if (!in->loaded) {
+        in->error  = batch_read(in->name, &in->data, &in->size);
+        in->loaded = 1;
+    }
+    pthread_mutex_unlock(&in->lock);
+    job->data      = in->data;
+    job->data_size = in->size;
+    return in->error;
+}
+
+static void release_input (struct INPUT *in) {
+    pthread_mutex_lock(&in->lock);
+    if (!--in->users) {
+        free(in->data);
+        in->data = NULL;
+    }
+    pthread_mutex_unlock(&in->lock);
+}
+
+static void *worker (void *arg) {
+    struct BATCH *b = arg;
+    for (;;) {
+        struct BATCH_JOB *job;
+        struct INPUT *in;
+        double start;
+        size_t i;
+        int queue;
+
+        pthread_mutex_lock(&b->lock);
+        i = b->next++;
+        pthread_mutex_unlock(&b->lock);
+        if (i >= b->job_count)
+            break;
+
+        job   = &b->jobs[i];
+        in    = b->job_input[i];
+        start = now();
+        if (!(job->error = acquire_input(in, job)))
+            job->error = b->run(job);
+        job->seconds = now() - start;
+
+        /* the checker releases the input once it's done with it */
+        queue = job->verify && !job->error;
+        pthread_mutex_lock(&b->lock);
+        if (queue)
+            b->queue[b->queued++] = i;
+        b->retired++;
+        pthread_cond_signal(&b->ready);
+        pthread_mutex_unlock(&b->lock);
+        if (!queue) {
+            release_input(in);
+            job->data = NULL;
+        }
+    }
+    return NULL;
+}
+
+/* checks jobs as they finish, so checking job N overlaps with */
+/* the workers running job N+1 and onwards                     */
+static void *checker (void *arg) {
+    struct BATCH *b = arg;
+    for (;;) {
+        struct BATCH_JOB *job;
+        double start;
+        size_t i;
+
+        pthread_mutex_lock(&b->lock);
+        while (b->checked == b->queued && b->retired < b->job_count)
+            pthread_cond_wait(&b->ready, &b->lock);
+        if (b->checked == b->queued) {
+            pthread_mutex_unlock(&b->lock);
+            break;
+        }
+        i = b->queue[b->checked++];
+        pthread_mutex_unlock(&b->lock);
+
+        job   = &b->jobs[i];
+        start = now();
+        job->error = b->check(job);
+        job->check_seconds = now() - start;
+        release_input(b->job_input[i]);
+        job->data = NULL;
+    }
+    return NULL;
+}
+
+static unsigned cpu_count (void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return n > 256 ? 256 : n;
+#endif
+    return 4;
+}
+
+static void run_batch (struct BATCH *b, unsigned threads) {
+    pthread_t thread[256], check;
+    unsigned i, started = 0;
+    int checking = 0;
+
+    if (threads > b->job_count)
+        threads = b->job_count;
+
+    if (b->queue != NULL)
+        checking = !pthread_create(&check, NULL, checker, b);
+    for (i = 0; i < threads; i++)
+        if (!pthread_create(&thread[i], NULL, worker, b))
+            started++;
+    if (!started) /* do it ourselves */
+        worker(b);
+    for (i = 0; i < started; i++)
+        pthread_join(thread[i], NULL);
+    if (checking)
+        pthread_join(check, NULL);
+    else if (b->queue != NULL) /* (everything has been queued by now) */
+        checker(b);
+}
+
+static int summarise (struct BATCH *b, unsigned threads, double seconds) {
+    size_t i, failed = 0, in_size = 0, out_size = 0;
+    double work = 0, checking = 0;
+
+    for (i = 0; i < b->job_count; i++) {
+        struct BATCH_JOB *job = &b->jobs[i];
+        work     += job->seconds;
+        checking += job->check_seconds;
+        if (job->error) {
+            printf("FAIL  %s: %s.\n", job->output, dk_get_error(job->error));
+            failed++;
+            continue;
+        }
+        printf("ok    %s: %zd -> %zd bytes (%.3f s)\n",
+            job->output, job->in_size, job->out_size, job->seconds);
+        in_size  += job->in_size;
+        out_size += job->out_size;
+    }
+    printf(
+        "%zd jobs, %zd failed, %zd -> %zd bytes in %.3f s "
+        "(%.3f s of work on %u threads)\n",
+        b->job_count, failed, in_size, out_size, seconds, work, threads
+    );
+    if (b->queue != NULL)
+        printf("%.3f s spent verifying alongside\n", checking);
+    return failed != 0;
+}
+
+int batch_main (
+    int argc,
+    char *argv[],
+    int positions,
+    int formats,
+    BATCH_FUNC run,
+    BATCH_FUNC check
+) {
+    struct BATCH b;
+    unsigned threads = cpu_count();
+    const char *manifest;
+    double start;
+    FILE *f;
+    int i, e, verify = 0;
+
+    if (argc < 3) {
+        fprintf(stderr, "No manifest given.\n");
+        return 1;
+    }
+    manifest = argv[2];
+    for (i = 3; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && ++i < argc) {
+            threads = strtol(argv[i], NULL, 0);
+            if (!threads || threads > 256) {
+                fprintf(stderr, "thread count should be between 1 and 256\n");
+                return 1;
+            }
+        }
+        else if (check != NULL && !strcmp(argv[i], "--verify")) {
+            verify = 1;
+        }
+        else {
+            fprintf(stderr, "unknown argument: \"%s\"\n", argv[i]);
+            return 1;
+        }
+    }
+
+    memset(&b, 0, sizeof(struct BATCH));
+    b.run   = run;
+    b.check = check;
+
+    if (!strcmp(manifest, "-")) {
+        f = stdin;
+    }
+    else if ((f = fopen(manifest, "r")) == NULL) {
+        fprintf(stderr, "Failed to open \"%s\".\n", manifest);
+        return 1;
+    }
+    e = read_manifest(&b, f, positions, formats);
+    if (f != stdin)
+        fclose(f);
+    if (e || find_inputs(&b)) {
+        free_batch(&b);
+        return 1;
+    }
+    if (verify && b.job_count) {
+        size_t j;
+        if ((b.queue = malloc(b.job_count * sizeof(size_t))) == NULL) {
+            fprintf(stderr, "Error: %s.\n", dk_get_error(DK_ERROR_ALLOC));
+            free_batch(&b);
+            return 1;
+        }
+        for (j = 0; j < b.job_count; j++)
+            b.jobs[j].verify = 1;
+    }
+
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.ready, NULL);
+    start = now();
+    run_batch(&b, threads);
+    e = summarise(&b, threads < b.job_count ? threads : b.job_count, now() - start);
+    pthread_cond_destroy(&b.ready);
+    pthread_mutex_destroy(&b.lock);
+    free_batch(&b);
+    return e;
+}
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - batch mode for the utilities */
+
+#ifndef DK_BATCH
+#define DK_BATCH
+
+#include <stddef.h>
+
+/* one line of the manifest: FORMAT OUTPUT INPUT [POSITION], tab separated */
+struct BATCH_JOB {
+    int format;
+    const char *output;
+    const char *input;
+    size_t offset;
+
+    /* filled in as the job runs */
+    unsigned char *data; /* the input file, shared between jobs */
+    size_t data_size;
+    size_t in_size;      /* how much of the input was used */
+    size_t out_size;
+    double seconds;
+    int error;
+
+    /* with --verify, run leaves its output here for check */
+    int verify;
+    unsigned char *result;
+    size_t result_size;
+    double check_seconds;
+};
+
+/* does the work for one job, returns a DK_ERROR */
+typedef int (*BATCH_FUNC)(struct BATCH_JOB*);
+
+/* handles "--batch MANIFEST [--threads NUM] [--verify]" where argv[1] is */
+/* "--batch", positions says whether lines have a fourth column, and     */
+/* formats is how many there are. check (which may be NULL) runs on a    */
+/* thread of its own after each job, while the workers carry on with the */
+/* next ones. returns 0 if every job succeeded */
+int batch_main (
+    int argc,
+    char *argv[],
+    int positions,
+    int formats,
+    BATCH_FUNC run,
+    BATCH_FUNC check
+);
+
+/* read a whole file into a new buffer, returns a DK_ERROR */
+int batch_read (const char *name, unsigned char **data, size_t *size);
+
+/* write a buffer to a file, returns a DK_ERROR */
+int batch_write (const char *name, unsigned char *data, size_t size);
+
+/* print the statistics from a --stats run */
+struct DK_STATS;
+void batch_stats (const struct DK_STATS *stats);
+
+#endif
@@ -0,0 +1,407 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - benchmark utility */
+
+/* every compressor is run over each shape of generated input at a */
+/* range of sizes, and the results are written to stdout as JSON so */
+/* they can be compared between releases */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if !defined(__WIN32__)
+#include <sys/resource.h>
+#endif
+#include "dkcomp.h"
+#include "gen_util.h"
+
+static const char *names[] = {
+    [        BD_COMP] = "bd",
+    [        SD_COMP] = "sd",
+    [    DKCCHR_COMP] = "dkcchr",
+    [    DKCGBC_COMP] = "dkcgbc",
+    [       DKL_COMP] = "dkl",
+    [  GBA_LZ77_COMP] = "gba_lz77",
+    [GBA_HUFF20_COMP] = "gba_huff20",
+    [   GBA_RLE_COMP] = "gba_rle",
+    [GBA_HUFF50_COMP] = "gba_huff50",
+    [GBA_HUFF60_COMP] = "gba_huff60",
+    [       GBA_COMP] = "gba",
+    [GB_PRINTER_COMP] = "gb_printer"
+};
+
+static double now (void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+
+
+/* heap counters */
+/* with glibc we can sit in front of malloc and see everything the */
+/* library allocates. elsewhere the counts are reported as null. */
+
+static struct {
+    int on;
+    size_t count;   /* allocations since the last reset */
+    long long live; /* bytes currently allocated */
+    long long peak;
+} heap;
+
+#if defined(__GLIBC__)
+#define HEAP_COUNTS 1
+
+extern void *__libc_malloc  (size_t);
+extern void *__libc_calloc  (size_t, size_t);
+extern void *__libc_realloc (void*, size_t);
+extern void  __libc_free    (void*);
+
+static void heap_add (void *p) {
+    if (p == NULL || !heap.on)
+        return;
+    heap.count++;
+    heap.live += malloc_usable_size(p);
+    if (heap.peak < heap.live)
+        heap.peak = heap.live;
+}
+static void heap_sub (void *p) {
+    if (p != NULL && heap.on)
+        heap.live -= malloc_usable_size(p);
+}
+
+void *malloc (size_t size) {
+    void *p = __libc_malloc(size);
+    heap_add(p);
+    return p;
+}
+void *calloc (size_t n, size_t size) {
+    void *p = __libc_calloc(n, size);
+    heap_add(p);
+    return p;
+}
+void *realloc (void *old, size_t size) {
+    void *p;
+    heap_sub(old);
+    if ((p = __libc_realloc(old, size)) == NULL && size) {
+        if (old != NULL && heap.on) /* (the old block is still there) */
+            heap.live += malloc_usable_size(old);
+        return NULL;
+    }
+    heap_add(p);
+    return p;
+}
+void free (void *p) {
+    heap_sub(p);
+    __libc_free(p);
+}
+#else
+#define HEAP_COUNTS 0
+#endif
+
+static void heap_start (void) {
+    heap.count = 0;
+    heap.live  = 0;
+    heap.peak  = 0;
+    heap.on    = 1;
+}
+static void heap_stop (void) {
+    heap.on = 0;
+}
+
+
+
+
+/* peak resident set size in KiB */
+/* on linux the high water mark can be reset between measurements, */
+/* otherwise it's the peak for the whole process so far */
+
+static void rss_reset (void) {
+#if defined(__linux__)
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f != NULL) {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+}
+
+static long rss_peak (void) {
+#if defined(__linux__)
+    char line[128];
+    long kib = -1;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL)
+            if (!strncmp(line, "VmHWM:", 6))
+                kib = strtol(line + 6, NULL, 10);
+        fclose(f);
+    }
+    if (kib >= 0)
+        return kib;
+#endif
+#if !defined(__WIN32__)
+    {
+        struct rusage ru;
+        if (!getrusage(RUSAGE_SELF, &ru))
+            return ru.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+
+
+
+/* measurements */
+
+struct RUN {
+    double mbps;   /* input bytes per second, in millions */
+    unsigned runs;
+    size_t allocs; /* (first run only) */
+    long long peak_heap;
+};
+
+struct RESULT {
+    size_t compressed_size;
+    struct RUN comp, decomp;
+    long rss;
+    int error;
+    const char *note;
+};
+
+struct CASE {
+    enum DK_FORMAT format;
+    unsigned char *input;
+    size_t size;
+    unsigned char *output; /* compressed data */
+    size_t output_size;
+};
+
+static int run_comp (struct CASE *c) {
+    return dk_compress_mem_to_mem(c->format, &c->output, &c->output_size, c->input, c->size);
+}
+
+static int run_decomp (struct CASE *c) {
+    unsigned char *output;
+    size_t output_size;
+    int e;
+    if ((e = dk_decompress_mem_to_mem(c->format, &output, &output_size, c->output, c->output_size)))
+        return e;
+    e = (output_size != c->size || memcmp(output, c->input, c->size)) ? -1 : 0;
+    free(output);
+    return e;
+}
+
+/* a dry run should come to the size that was actually written */
+static int check_estimate (struct CASE *c) {
+    size_t size;
+    int e;
+    if ((e = dk_compressed_size_estimate(c->format, c->input, c->size, NULL, &size)))
+        return e;
+    return (size != c->output_size) ? -1 : 0;
+}
+
+/* keep going until we've spent long enough to get a stable number */
+static int measure (
+    struct CASE *c,
+    int comp,
+    double min_time,
+    struct RUN *run
+) {
+    double start, elapsed;
+    int e;
+
+    run->runs = 0;
+    start = now();
+    do {
+        if (comp && run->runs) {
+            free(c->output);
+            c->output = NULL;
+        }
+        if (!run->runs)
+            heap_start();
+        e = comp ? run_comp(c) : run_decomp(c);
+        if (!run->runs) {
+            heap_stop();
+            run->allocs    = heap.count;
+            run->peak_heap = heap.peak;
+        }
+        if (e)
+            return e;
+        run->runs++;
+        elapsed = now() - start;
+    } while (elapsed < min_time);
+
+    run->mbps = (elapsed > 0) ? c->size * (double)run->runs / elapsed / 1e6 : 0;
+    return 0;
+}
+
+static void bench_case (struct CASE *c, double min_time, struct RESULT *r) {
+    memset(r, 0, sizeof(struct RESULT));
+    rss_reset();
+    if ((r->error = measure(c, 1, min_time, &r->comp))) {
+        r->note = "compress";
+    }
+    else {
+        r->compressed_size = c->output_size;
+        if ((r->error = check_estimate(c)))
+            r->note = "estimate";
+        else if ((r->error = measure(c, 0, min_time, &r->decomp)))
+            r->note = "decompress";
+    }
+    r->rss = rss_peak();
+    free(c->output);
+    c->output = NULL;
+}
+
+
+
+
+/* output */
+
+static void print_run (const char *name, struct RUN *run) {
+    printf("\"%s\": { \"mbps\": %.3f, \"runs\": %u, ", name, run->mbps, run->runs);
+    if (HEAP_COUNTS)
+        printf("\"allocs\": %zu, \"peak_heap\": %lld }", run->allocs, run->peak_heap);
+    else
+        printf("\"allocs\": null, \"peak_heap\": null }");
+}
+
+static void print_result (
+    int first,
+    struct CASE *c,
+    const char *kind,
+    struct RESULT *r
+) {
+    printf("%s\n    { \"format\": %d, \"name\": \"%s\", \"input\": \"%s\", \"size\": %zu, ",
+           first ? "" : ",", c->format, names[c->format], kind, c->size);
+    if (r->error) {
+        printf("\"error\": \"%s: %s\" }", r->note,
+               (r->error >= 0)               ? dk_get_error(r->error)
+             : !strcmp(r->note, "estimate") ? "Size doesn't match the output"
+                                             : "Output doesn't match the input");
+    }
+    else {
+        printf("\"compressed\": %zu, \"ratio\": %.4f,\n      ",
+               r->compressed_size, (double)r->compressed_size / c->size);
+        print_run("compress",   &r->comp);   printf(",\n      ");
+        print_run("decompress", &r->decomp); printf(",\n      ");
+        printf("\"peak_rss_kib\": %ld }", r->rss);
+    }
+    fflush(stdout);
+}
+
+static void usage (void) {
+    int i;
+    puts("Usage: ./dkbench [OPTIONS]\n\n"
+         "Options:\n"
+         "  --format NUM     only benchmark this format\n"
+         "  --max-size SIZE  largest input to try (default 65536, 0 for each\n"
+         "                   format's own limit)\n"
+         "  --time SECONDS   how long to spend on each measurement (default 0.1)\n"
+         "  --seed NUM       seed for the generated inputs (default 1)\n"
+         "  --shape NAME     only use this shape of input\n"
+         "  --run NUM        longest run of one value or sequence\n"
+         "  --repeat PCT     how often runs reuse a recent value\n"
+         "  --increment PCT  how often runs count upwards\n\n"
+         "Shapes:");
+    for (i = 0; i < GEN_LIMIT; i++)
+        printf("  %s\n", gen_name(i));
+    puts("\n"
+         "Results are written to stdout as JSON.");
+}
+
+int main (int argc, char *argv[]) {
+    int format = -1, first = 1, i;
+    size_t max_size = 65536;
+    double min_time = 0.1;
+    unsigned long long seed = 1;
+    int shape = -1, run = -1, repeat = -1, increment = -1;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "--format"))
+            format = strtol(argv[++i], NULL, 0);
+        else if (i + 1 < argc && !strcmp(argv[i], "--max-size"))
+            max_size = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < argc && !strcmp(argv[i], "--time"))
+            min_time = strtod(argv[++i], NULL);
+        else if (i + 1 < argc && !strcmp(argv[i], "--seed"))
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < argc && !strcmp(argv[i], "--shape")) {
+            if ((shape = gen_shape(argv[++i])) < 0) {
+                fprintf(stderr, "Error: Unknown shape \"%s\".\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--run"))
+            run = strtol(argv[++i], NULL, 0);
+        else if (i + 1 < argc && !strcmp(argv[i], "--repeat"))
+            repeat = strtol(argv[++i], NULL, 0);
+        else if (i + 1 < argc && !strcmp(argv[i], "--increment"))
+            increment = strtol(argv[++i], NULL, 0);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (format >= COMP_LIMIT || (format >= 0 && !dk_compress_limit(format))) {
+        fprintf(stderr, "Error: %s.\n", dk_get_error(DK_ERROR_COMP_NOT));
+        return 1;
+    }
+
+    printf("{\n  \"seed\": %llu, \"time\": %g, \"heap_counts\": %s,\n  \"results\": [",
+           seed, min_time, HEAP_COUNTS ? "true" : "false");
+
+    for (i = 0; i < COMP_LIMIT; i++) {
+        size_t limit = dk_compress_limit(i);
+        size_t size;
+        int k;
+
+        if (!limit || (format >= 0 && format != i))
+            continue;
+        if (max_size && limit > max_size)
+            limit = max_size;
+
+        /* sizes go up by a factor of four, always ending at the limit */
+        size = (limit < 256) ? limit : 256;
+        if (i == GB_PRINTER_COMP) /* (only takes one size of input) */
+            size = limit = 0x280;
+        for (;;) {
+            for (k = 0; k < GEN_LIMIT; k++) {
+                struct CASE c = { i, NULL, size, NULL, 0 };
+                struct GEN_PARAMS p;
+                struct RESULT r;
+
+                if (shape >= 0 && shape != k)
+                    continue;
+
+                if ((c.input = malloc(size)) == NULL) {
+                    fprintf(stderr, "Error: %s.\n", dk_get_error(DK_ERROR_ALLOC));
+                    return 1;
+                }
+                gen_defaults(k, &p);
+                p.seed = seed;
+                if (run       >= 0) p.run       = run;
+                if (repeat    >= 0) p.repeat    = repeat;
+                if (increment >= 0) p.increment = increment;
+                gen_fill(k, &p, c.input, size);
+
+                bench_case(&c, min_time, &r);
+                print_result(first, &c, gen_name(k), &r);
+                first = 0;
+                free(c.input);
+            }
+            if (size == limit)
+                break;
+            size = (size * 4 > limit) ? limit : size * 4;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -36,42 +36,17 @@ static int write_word (struct COMPRESSOR *dk, unsigned val) {
 
 /* some data structures */
 
-struct PATH {
-    struct PATH *link;
-    size_t used; /* smallest number of nibbles to get here */
-    unsigned char ncase;  /* which case brought us here? */
-    unsigned short arg; /* 9,10,11,12,15 */
-};
+/* each case is stored with its argument (9,10,11,12,15) above it */
+#define NCASE(ncase, arg) ((uint32_t)(arg) << 8 | (ncase))
+
 struct BIN {
     struct COMPRESSOR *dk;
-    struct PATH *steps;
+    struct DK_PATH path; /* cost is the smallest number of nibbles to get here */
     unsigned short *root; /* hash table */
     unsigned short *link;
 };
 
 
-/* path shenanigans */
-
-static void clear_path (struct BIN *bin) {
-    size_t i;
-    for (i = 0; i <= bin->dk->in.length; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, 0, 0 };
-        bin->steps[i] = p;
-    }
-    bin->steps[0].used = 0;
-}
-static void reverse_path (struct BIN *bin) {
-    struct PATH *prev = &bin->steps[bin->dk->in.length];
-    struct PATH *step = prev->link;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
-    }
-}
-
-
 /* hashing functions for window testing */
 
 static unsigned short hash3 (unsigned char *data, int i) {
@@ -86,7 +61,8 @@ static int hash_triplets (struct BIN *bin) {
     bin->root = malloc(rootlen);
     bin->link = malloc(linklen);
     if (bin->root == NULL || bin->link == NULL) {
-        free(bin->root);
+        free(bin->root); bin->root = NULL;
+        free(bin->link); bin->link = NULL;
         return DK_ERROR_ALLOC;
     }
     memset(bin->root, -1, rootlen);
@@ -129,7 +105,6 @@ static int in_wlut (struct COMPRESSOR *dk, unsigned short val) {
 
 static void test_rle (struct BIN *bin, size_t i) {
     unsigned char *data = &bin->dk->in.data[i];
-    struct PATH *step = &bin->steps[i];
     size_t j = 0;
     size_t limit = 18;
 
@@ -141,37 +116,31 @@ static void test_rle (struct BIN *bin, size_t i) {
     while (++j < limit && data[0] == data[j]);
 
     while (j >= 3) {
-        struct PATH *next = &step[j];
-        struct PATH p = { step, 2+step->used, 3+in_rle(bin->dk, data[0]), 0};
-        if (p.ncase == 3)
-            p.used += 2;
-        if (next->used > p.used)
-           *next = p;
+        int ncase = 3+in_rle(bin->dk, data[0]);
+        uint32_t used = 2+bin->path.cost[i];
+        if (ncase == 3)
+            used += 2;
+        path_test(&bin->path, i, j, used, NCASE(ncase, 0));
         j--;
     }
 }
 
 static void test_constants (struct BIN *bin, size_t i) {
     unsigned char *data = &bin->dk->in.data[i];
-    struct PATH *step = &bin->steps[i];
+    uint32_t cost = bin->path.cost[i];
     int ncase;
 
     /* 7,8 (byte LUT) */
-    if ((ncase = in_blut(bin->dk, data[0]))
-    &&  step[1].used > (1 + step->used)) {
-        struct PATH p = { step, 1+step->used, 4+ncase, 0 };
-        step[1] = p;
-    }
+    if ((ncase = in_blut(bin->dk, data[0])))
+        path_test(&bin->path, i, 1, 1+cost, NCASE(4+ncase, 0));
 
     /* 6  (word constant) */
     /* 15 (word LUT) */
     if ((i+1) < bin->dk->in.length
     && (ncase = in_wlut(bin->dk, data[0] | (data[1] << 8)))) {
-        size_t used = 1 + step->used + (ncase > 5);
-        if (step[2].used > used) {
-            struct PATH p = { step, used, (ncase > 5) ? 15:6, (ncase-7)/2 };
-            step[2] = p;
-        }
+        uint32_t used = 1 + cost + (ncase > 5);
+        path_test(&bin->path, i, 2, used,
+                  NCASE((ncase > 5) ? 15:6, (unsigned short)((ncase-7)/2)));
     }
 
 }
@@ -179,58 +148,44 @@ static void test_constants (struct BIN *bin, size_t i) {
 static void test_repeat (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
     unsigned char *data = &bin->dk->in.data[i];
-    struct PATH *step = &bin->steps[i];
-    struct PATH p = { step, 1+step->used, 13, 0 };
+    uint32_t used = 1+bin->path.cost[i];
 
     /* 13 (repeat byte) */
-    if (i && data[-1] == data[0]
-    &&  step[1].used > p.used)
-        step[1] = p;
+    if (i && data[-1] == data[0])
+        path_test(&bin->path, i, 1, used, NCASE(13, 0));
 
     /* 14 (repeat word) */
-    p.ncase++;
     if (i > 1
     && (i + 1) < dk->in.length
     &&  data[-2] == data[0]
-    &&  data[-1] == data[1]
-    &&  step[2].used > p.used)
-        step[2] = p;
+    &&  data[-1] == data[1])
+        path_test(&bin->path, i, 2, used, NCASE(14, 0));
 
 }
 
 static void test_copy (struct BIN *bin, size_t i) {
-    struct PATH *step = &bin->steps[i];
-    struct PATH p = { step, 0, 0, 0 };
+    uint32_t cost = bin->path.cost[i];
     size_t limit = bin->dk->in.length - i;
     size_t j;
     if (limit > 16)
         limit = 16;
 
     /* 0 (copy 3-18 bytes) */
-    for (j = 3; j < limit; j++) {
-        p.used = 2+(2*j) + step->used;
-        if (step[j].used > p.used)
-            step[j] = p;
-    }
+    for (j = 3; j < limit; j++)
+        path_test(&bin->path, i, j, 2+(2*j) + cost, NCASE(0, 0));
 
     /* 1 (single byte) */
-    p.ncase = 1;
-    p.used  = 3+step->used;
-    if (limit
-    &&  step[1].used > p.used)
-        step[1] = p;
+    if (limit)
+        path_test(&bin->path, i, 1, 3+cost, NCASE(1, 0));
 
     /* 2 (single word) */
-    p.ncase = 2;
-    p.used  = 5+step->used;
-    if (limit > 1
-    &&  step[2].used > p.used)
-        step[2] = p;
+    if (limit > 1)
+        path_test(&bin->path, i, 2, 5+cost, NCASE(2, 0));
 }
 
 static void test_word (struct BIN *bin, size_t i) {
-    struct PATH *step = &bin->steps[i];
     unsigned char *data = bin->dk->in.data;
+    uint32_t used = 2+bin->path.cost[i];
     size_t  j = 0;
 
     /* 9 (recent word) */
@@ -239,11 +194,11 @@ static void test_word (struct BIN *bin, size_t i) {
             j = i - 17;
 
         for (; (j+1) < i; j++) {
-            struct PATH p = { step, 2+step->used, 9, .arg = i-j-2 };
-            if (step[2].used <= p.used)
+            if (bin->path.cost[i+2] <= used)
                 break;
+            stats_probe(bin->dk);
             if (data[i] == data[j] && data[i+1] == data[j+1]) {
-                step[2] = p;
+                path_test(&bin->path, i, 2, used, NCASE(9, (unsigned short)(i-j-2)));
                 break;
             }
         }
@@ -251,8 +206,8 @@ static void test_word (struct BIN *bin, size_t i) {
 }
 
 static void test_win (struct BIN *bin, size_t i) {
-    struct PATH *step = &bin->steps[i];
     unsigned char *data = bin->dk->in.data;
+    uint32_t cost = bin->path.cost[i];
     unsigned short point;
 
     /* (3-18 bytes from 8/12/16 bit window) */
@@ -262,11 +217,13 @@ static void test_win (struct BIN *bin, size_t i) {
     point = bin->root[hash3(bin->dk->in.data, i)];
 
     for (; point != 0xFFFF; point = bin->link[point]) {
-        struct PATH p = { step, step->used, 0, 0 };
+        unsigned short arg = 0;
+        int ncase = 0;
         unsigned limit = 18;
         unsigned m, matched = 0;
         if (point >= i-3)
             continue;
+        stats_probe(bin->dk);
         if (limit > i-point)
             limit = i-point;
         if (limit > bin->dk->in.length-i)
@@ -276,33 +233,47 @@ static void test_win (struct BIN *bin, size_t i) {
 
         /* do cases each time */
         for (m = matched; m >= 3; m--) {
-            p.arg = i - point;
-            if (p.arg < (256+m)) {
-                p.used  = step->used + 4;
-                p.ncase = 10;
-                p.arg  -= m;
+            uint32_t used;
+            arg = i - point;
+            if (arg < (256+m)) {
+                used  = cost + 4;
+                ncase = 10;
+                arg  -= m;
             }
-            else if (p.arg > 258 && p.arg <= (4095+259)) {
-                p.used  = step->used + 5;
-                p.ncase = 11;
-                p.arg  -= 0x103;
+            else if (arg > 258 && arg <= (4095+259)) {
+                used  = cost + 5;
+                ncase = 11;
+                arg  -= 0x103;
             }
             else {
-                p.used  = step->used + 6;
-                p.ncase = 12;
+                used  = cost + 6;
+                ncase = 12;
             }
-            if (p.used < step[m].used)
-                step[m] = p;
+            path_test(&bin->path, i, m, used, NCASE(ncase, arg));
         }
-        if (p.ncase == 10 && matched == 18)
+        if (ncase == 10 && matched == 18)
             return;
     }
 }
 
-static void test_cases (struct BIN *bin) {
+/* no case reads or steps more than this far ahead (see path_resume) */
+#define REACH 18
+
+/* every path to the end passes through one of the next 18 nodes, */
+/* so the cheapest of those is a lower bound for the final size */
+static int over_budget (struct BIN *bin, size_t i) {
+    uint32_t least = path_least(&bin->path, i, REACH);
+    return least != PATH_UNSEEN
+        && OVER_BUDGET(bin->dk, 0x27 + (least + 3) / 2);
+}
+
+static int test_cases (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
-    size_t i;
-    for (i = 0; i < dk->in.length; i++) {
+    for (; i < dk->in.length; i++) {
+        if (dk->opt.budget && !(i & 255) && over_budget(bin, i))
+            return DK_ERROR_BUDGET;
+        if (dk_poll(dk, dk->in.length + i, 2 * dk->in.length))
+            return DK_ERROR_CANCELLED;
         test_constants(bin, i);
         test_repeat   (bin, i);
         test_copy     (bin, i);
@@ -310,18 +281,21 @@ static void test_cases (struct BIN *bin) {
         test_win      (bin, i);
         test_rle      (bin, i);
     }
+    return 0;
 }
 
-static void test_nc_cases (struct BIN *bin) {
+static int test_nc_cases (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
-    size_t i;
-    for (i = 0; i < dk->in.length; i++) {
+    for (; i < dk->in.length; i++) {
+        if (dk_poll(dk, i, 2 * dk->in.length)) /* (first of two passes) */
+            return DK_ERROR_CANCELLED;
         test_repeat(bin, i);
         test_copy  (bin, i);
         test_word  (bin, i);
         test_win   (bin, i);
         test_rle   (bin, i);
     }
+    return 0;
 }
 
 
@@ -443,8 +417,10 @@ static void filter_constants (struct CLUT *clut) {
 
 /* iterate over data that can only be handled by copy cases */
 static int choose_constants (struct BIN *bin) {
-    struct PATH *step = bin->steps;
+    struct DK_PATH *path = &bin->path;
+    struct DK_PARSE *parse = bin->dk->parse;
     struct CLUT clut;
+    size_t i, from = 0;
     enum DK_ERROR e;
 
     if ((e = init_constant_lut(&clut)))
@@ -456,26 +432,32 @@ static int choose_constants (struct BIN *bin) {
     bin->dk->out.data[1] = clut.rle[0].index;
     bin->dk->out.data[2] = clut.rle[1].index;
 
-    test_nc_cases(bin);
-    reverse_path (bin);
+    /* this pass only depends on the RLE constants */
+    /* (which can be in a different order in the header) */
+    if (parse != NULL && !memcmp(&bin->dk->out.data[1], parse->rle, 2))
+        from = path_resume(path, &parse->path[0], parse->edit, REACH);
+
+    if ((e = test_nc_cases(bin, from))
+    ||  (parse != NULL && (e = path_save(path, &parse->path[0])))) {
+        free(clut.rle);
+        return e;
+    }
+    if (parse != NULL)
+        memcpy(parse->rle, &bin->dk->out.data[1], 2);
+    path_reverse(path);
 
     /* only count areas that aren't covered by better cases */
-    while (step != &bin->steps[bin->dk->in.length]) {
-        struct PATH *next = step->link;
+    for (i = 0; i < path->length; i += path->len[i]) {
+        size_t next = i + path->len[i];
 
-        switch (next->ncase) {
+        switch (path->ncase[next] & 255) {
             case 0: case 1: case 2: {
-                constant_count_single(
-                    bin->dk, &clut,
-                    step - bin->steps,
-                    next - bin->steps
-                );
+                constant_count_single(bin->dk, &clut, i, next);
                 break;
             }
         }
-        step = next;
     }
-    clear_path(bin);
+    path_clear(path);
     filter_constants(&clut);
     if (write_constants(bin->dk, &clut)) {
         free(clut.rle);
@@ -488,17 +470,21 @@ static int choose_constants (struct BIN *bin) {
 
 /* data encoding */
 
-static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
+static int encode_case (struct BIN *bin, size_t pos) {
 
     struct COMPRESSOR *dk = bin->dk;
-    int len = next - step;
+    int len = bin->path.len[pos];
+    int ncase = bin->path.ncase[pos+len] & 255;
+    unsigned short arg = bin->path.ncase[pos+len] >> 8;
     int z;
 
+    stats_case(dk, ncase, len);
+
     /* write case */
-    if (write_nibble(dk, next->ncase))
+    if (write_nibble(dk, ncase))
         return DK_ERROR_OOB_OUTPUT_W;
 
-    switch (next->ncase) {
+    switch (ncase) {
 
         /* n bytes */
         case 0: {
@@ -554,7 +540,7 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
 
         /* Word window */
         case 9: {
-            if (write_nibble(dk, next->arg))
+            if (write_nibble(dk, arg))
                 return DK_ERROR_OOB_OUTPUT_W;
             dk->in.pos += 2;
             break;
@@ -563,7 +549,7 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
         /* 8-bit window */
         case 10: {
             if (write_nibble(dk, len - 3)
-            ||  write_byte  (dk, next->arg))
+            ||  write_byte  (dk, arg))
                 return DK_ERROR_OOB_OUTPUT_W;
             dk->in.pos += len;
             break;
@@ -572,8 +558,8 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
         /* 12-bit window */
         case 11: {
             if (write_nibble(dk, len - 3)
-            ||  write_byte  (dk, next->arg >> 4)
-            ||  write_nibble(dk, next->arg & 15))
+            ||  write_byte  (dk, arg >> 4)
+            ||  write_nibble(dk, arg & 15))
                 return DK_ERROR_OOB_OUTPUT_W;
             dk->in.pos += len;
             break;
@@ -582,7 +568,7 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
         /* 16-bit window */
         case 12: {
             if (write_nibble(dk, len - 3)
-            ||  write_word  (dk, next->arg))
+            ||  write_word  (dk, arg))
                 return DK_ERROR_OOB_OUTPUT_W;
             dk->in.pos += len;
             break;
@@ -590,7 +576,7 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
 
         /* Word LUT */
         case 15: {
-            if (write_nibble(dk, next->arg))
+            if (write_nibble(dk, arg))
                 return DK_ERROR_OOB_OUTPUT_W;
             dk->in.pos += 2;
             break;
@@ -600,13 +586,11 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
 }
 
 static int write_output (struct BIN *bin) {
-    struct PATH *step = bin->steps;
+    size_t pos;
     enum DK_ERROR e;
-    while (step != &bin->steps[bin->dk->in.length]) {
-        if ((e = encode_case(bin, step, step->link)))
+    for (pos = 0; pos < bin->dk->in.length; pos += bin->path.len[pos])
+        if ((e = encode_case(bin, pos)))
             return e;
-        step = step->link;
-    }
     if (write_byte(bin->dk, 0)
     || (bin->dk->out.bitpos && write_nibble(bin->dk, 0)))
         return DK_ERROR_OOB_OUTPUT_W;
@@ -615,32 +599,72 @@ static int write_output (struct BIN *bin) {
 
 
 int bd_compress (struct COMPRESSOR *dk) {
-    struct PATH *steps = malloc((dk->in.length+1) * sizeof(struct PATH));
-    struct BIN bin = { dk, steps, NULL, NULL };
+    struct BIN bin = { .dk = dk };
+    unsigned char header[0x27];
+    double t = stats_start(dk);
+    size_t from = 0, limit = dk->out.limit;
     enum DK_ERROR e;
 
-    if (steps == NULL)
-        return DK_ERROR_ALLOC;
+    /* the search looks up constants in the header, */
+    /* so a dry run still needs somewhere to put it  */
+    if (dk->dry_run) {
+        dk->out.data  = header;
+        dk->out.limit = sizeof(header);
+    }
 
-    clear_path(&bin);
+    if ((e = path_init(&bin.path, dk->in.length)))
+        return e;
 
     if ((e =    hash_triplets(&bin))
     ||  (e = choose_constants(&bin))) {
-        free(steps);
+        path_free(&bin.path);
+        free(bin.root);
+        free(bin.link);
         return e;
     }
+    stats_phase(dk, DK_PHASE_SETUP, &t);
+
+    /* an edit that changes the constants changes every cost */
+    if (dk->parse != NULL && !memcmp(dk->out.data, dk->parse->header, 0x27))
+        from = path_resume(&bin.path, &dk->parse->path[1], dk->parse->edit, REACH);
+
+    /* (0x27 byte header, 2 nibble terminator) */
+    if ((e = test_cases(&bin, from))
+    ||  (dk->parse != NULL && (e = path_save(&bin.path, &dk->parse->path[1])))
+    ||  (OVER_BUDGET(dk, 0x27 + (bin.path.cost[dk->in.length] + 3) / 2)
+    &&  (e = DK_ERROR_BUDGET))) {
+        path_free(&bin.path);
+        free(bin.root);
+        free(bin.link);
+        return e;
+    }
+    stats_phase(dk, DK_PHASE_SEARCH, &t);
+    if (dk->parse != NULL)
+        memcpy(dk->parse->header, dk->out.data, 0x27);
+
+    if (dk->dry_run) {
+        dk->out.data  = NULL;
+        dk->out.limit = limit; /* (the caller checks the size against it) */
+        dk->out.pos   = 0x27 + (bin.path.cost[dk->in.length] + 3) / 2;
+        path_free(&bin.path);
+        free(bin.root);
+        free(bin.link);
+        return 0;
+    }
 
-    test_cases  (&bin);
-    reverse_path(&bin);
+    path_reverse(&bin.path);
+    stats_phase(dk, DK_PHASE_REVERSE, &t);
 
     if ((e = write_output(&bin))) {
-        free(steps);
+        path_free(&bin.path);
         free(bin.root);
         free(bin.link);
         return e;
     }
+    stats_phase(dk, DK_PHASE_EMIT, &t);
+    stats_path(dk, &bin.path);
 
-    free(steps);
+    path_free(&bin.path);
     free(bin.root);
     free(bin.link);
     return 0;
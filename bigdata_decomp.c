@@ -56,6 +56,7 @@ static int copy_byte (struct COMPRESSOR *dk) {
 static int bd_loop (struct COMPRESSOR *dk) {
     enum DK_ERROR e;
     for (;;) {
+        size_t start = dk->out.pos;
         int c;
         if ((c = read_nibble(dk)) < 0)
             return DK_ERROR_OOB_INPUT;
@@ -148,6 +149,8 @@ static int bd_loop (struct COMPRESSOR *dk) {
                     return DK_ERROR_OOB_INPUT;
                 i += 3;
                 addr += i;
+                if (addr < i)
+                    stats_slow(dk);
                 while (i--)
                     if ((e = relay_byte(dk, addr)))
                         return e;
@@ -163,6 +166,8 @@ static int bd_loop (struct COMPRESSOR *dk) {
                     return DK_ERROR_OOB_INPUT;
                 i += 3;
                 addr = ((addr << 4) | lo) + 0x103;
+                if (addr < i)
+                    stats_slow(dk);
                 while (i--)
                     if ((e = relay_byte(dk, addr)))
                         return e;
@@ -178,6 +183,8 @@ static int bd_loop (struct COMPRESSOR *dk) {
                     return DK_ERROR_OOB_INPUT;
                 i += 3;
                 addr = (addr << 8) | lo;
+                if (addr < i)
+                    stats_slow(dk);
                 while (i--)
                     if ((e = relay_byte(dk, addr)))
                         return e;
@@ -211,10 +218,37 @@ static int bd_loop (struct COMPRESSOR *dk) {
                 break;
             }
         }
+        stats_case(dk, c, dk->out.pos - start);
     }
 
 }
 
+/* the header is a zero byte followed by two RLE constants, two byte */
+/* constants and 17 word constants. the compressor picks them from    */
+/* different values, so neighbours that repeat count against it.     */
+int bd_probe (struct COMPRESSOR *dk) {
+    const unsigned char *d = dk->in.data;
+    int score = 10, c, i;
+
+    if (dk->in.length < 0x28)
+        return 0;
+
+    /* the first command can't end straight away, */
+    /* or refer to output that doesn't exist yet  */
+    c = d[0x27] >> 4;
+    if (!d[0x27] || (c >= 9 && c <= 14))
+        return 0;
+
+    if (!d[0])
+        score += 30;
+    if (d[1] != d[2] && d[3] != d[4])
+        score += 20;
+    for (i = 7; i < 0x27; i += 2)
+        if (d[i] == d[i-2] && d[i+1] == d[i-1])
+            return score;
+    return score + 30;
+}
+
 int bd_decompress (struct COMPRESSOR *dk) {
 
     enum DK_ERROR e;
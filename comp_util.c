@@ -6,6 +6,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include "dkcomp.h"
+#include "batch_util.h"
+
+static const struct DK_ID {
+    enum DK_FORMAT id;
+    char *name;
+} formats[] = {
+    {        BD_COMP, "SNES DKC2/DKC3 Big Data"    },
+    {        SD_COMP, "SNES DKC3 Small Data"       },
+    {    DKCCHR_COMP, "SNES DKC Tilesets"          },
+    {    DKCGBC_COMP, " GBC DKC Tilemaps"          },
+    {       DKL_COMP, " GB  DKL/DKL2/DKL3 Tilemaps"},
+    {  GBA_LZ77_COMP, " GBA BIOS LZ77 (10)"        },
+    {GBA_HUFF20_COMP, " GBA BIOS Huffman (20)"     },
+    {   GBA_RLE_COMP, " GBA BIOS RLE (30)"         },
+    {GBA_HUFF50_COMP, " GBA Huffman (50)"          },
+    {GBA_HUFF60_COMP, " GBA Huffman (60)"          },
+    {       GBA_COMP, "     Reserved"              },
+    {GB_PRINTER_COMP, " GB  Printer"               }
+};
+static const int format_count = sizeof(formats) / sizeof(struct DK_ID);
 
 static void check_size (const char *name) {
     FILE *f = fopen(name, "rb");
@@ -26,42 +46,111 @@ static void check_size (const char *name) {
     printf("Output size is %zd bytes.\n", len);
 }
 
+/* with --verify the output is only written once check_compress */
+/* has decompressed it again, on the batch's checking thread     */
+static int batch_compress (struct BATCH_JOB *job) {
+    unsigned char *output;
+    size_t output_size;
+    int e;
+    if ((e = dk_compress_mem_to_mem(formats[job->format].id, &output, &output_size, job->data, job->data_size)))
+        return e;
+    job->in_size  = job->data_size;
+    job->out_size = output_size;
+    if (job->verify) {
+        job->result      = output;
+        job->result_size = output_size;
+        return 0;
+    }
+    e = batch_write(job->output, output, output_size);
+    free(output);
+    return e;
+}
+
+static int check_compress (struct BATCH_JOB *job) {
+    int e = dk_verify(formats[job->format].id, job->result, job->result_size, job->data, job->data_size);
+    if (!e)
+        e = batch_write(job->output, job->result, job->result_size);
+    free(job->result);
+    job->result = NULL;
+    return e;
+}
+
+/* compress through memory so the library can fill in the statistics */
+/* or check the output */
+static int compress_opt (int format, const char *file_out, const char *file_in, int stats, int verify) {
+    struct DK_STATS st;
+    struct DK_OPTIONS opt;
+    unsigned char *input, *output;
+    size_t input_size, output_size;
+    int e;
+
+    memset(&opt, 0, sizeof(struct DK_OPTIONS));
+    opt.stats  = stats ? &st : NULL;
+    opt.verify = verify;
+
+    if ((e = batch_read(file_in, &input, &input_size)))
+        return e;
+    e = dk_compress_mem_to_mem_opt(format, &output, &output_size, input, input_size, &opt);
+    free(input);
+    if (e)
+        return e;
+    e = batch_write(file_out, output, output_size);
+    free(output);
+    if (e)
+        return e;
+
+    printf("Output size is %zd bytes.\n", output_size);
+    if (stats)
+        batch_stats(&st);
+    return 0;
+}
+
 int main (int argc, char *argv[]) {
 
-    static const struct DK_ID {
-        enum DK_FORMAT id;
-        char *name;
-    } formats[] = {
-        {        BD_COMP, "SNES DKC2/DKC3 Big Data"    },
-        {        SD_COMP, "SNES DKC3 Small Data"       },
-        {    DKCCHR_COMP, "SNES DKC Tilesets"          },
-        {    DKCGBC_COMP, " GBC DKC Tilemaps"          },
-        {       DKL_COMP, " GB  DKL/DKL2/DKL3 Tilemaps"},
-        {  GBA_LZ77_COMP, " GBA BIOS LZ77 (10)"        },
-        {GBA_HUFF20_COMP, " GBA BIOS Huffman (20)"     },
-        {   GBA_RLE_COMP, " GBA BIOS RLE (30)"         },
-        {GBA_HUFF50_COMP, " GBA Huffman (50)"          },
-        {GBA_HUFF60_COMP, " GBA Huffman (60)"          },
-        {       GBA_COMP, "     Reserved"              },
-        {GB_PRINTER_COMP, " GB  Printer"               }
-    };
-    static const int size = sizeof(formats) / sizeof(struct DK_ID);
-    int e, i, format = 0;
+    int e, i, format = 0, stats = 0, verify = 0;
+
+    if (argc >= 2 && !strcmp(argv[1], "--batch"))
+        return batch_main(argc, argv, 0, format_count, batch_compress, check_compress);
+
+    for (; argc > 4; argc--, argv++) {
+        if (!strcmp(argv[1], "--stats"))
+            stats = 1;
+        else if (!strcmp(argv[1], "--verify"))
+            verify = 1;
+        else
+            break;
+    }
 
     if (argc != 4) {
-        puts("Usage: ./comp FORMAT OUTPUT INPUT\n\n"
+        puts("Usage: ./comp [--stats] [--verify] FORMAT OUTPUT INPUT\n"
+             "       ./comp --batch MANIFEST [--threads NUM] [--verify]\n\n"
+             "--stats reports what the compressor did, if the library was built\n"
+             "with DKCOMP_STATS.\n\n"
+             "--verify decompresses the output again and only writes it if it\n"
+             "matches the input. In batch mode this happens on a separate thread\n"
+             "while the next jobs are compressed.\n\n"
+             "A manifest has one FORMAT OUTPUT INPUT per line, separated by tabs.\n"
+             "Use - to read it from stdin.\n\n"
              "Supported compression formats:");
-        for (i = 0; i < size; i++)
+        for (i = 0; i < format_count; i++)
             printf("  %2d - %s\n", i, formats[i].name);
         return 1;
     }
 
     format = strtol(argv[1], NULL, 0);
-    if (format < 0 || format >= size) {
+    if (format < 0 || format >= format_count) {
         fprintf(stderr, "Unsupported compression format.\n");
         return 1;
     }
 
+    if (stats || verify) {
+        if ((e = compress_opt(formats[format].id, argv[2], argv[3], stats, verify))) {
+            fprintf(stderr, "Error: %s.\n", dk_get_error(e));
+            return 1;
+        }
+        return 0;
+    }
+
     if ((e = dk_compress_file_to_file(formats[format].id, argv[2], argv[3]))) {
         fprintf(stderr, "Error: %s.\n", dk_get_error(e));
         return 1;
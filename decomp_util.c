@@ -6,78 +6,136 @@
 #include <stdlib.h>
 #include <string.h>
 #include "dkcomp.h"
+#include "batch_util.h"
 
-static void check_size (const char *name, size_t compressed_size) {
-    FILE *f = fopen(name, "rb");
-    size_t len;
-    if (f == NULL) {
-        fprintf(stderr, "Failed to open output file. (size check)\n");
-        return;
-    }
+static const struct DK_ID {
+    enum DK_FORMAT id;
+    char *name;
+} formats[] = {
+    {        BD_COMP, "SNES DKC2/DKC3 Big Data"    },
+    {        SD_COMP, "SNES DKC3 Small Data"       },
+    {    DKCCHR_COMP, "SNES DKC Tilesets"          },
+    {    DKCGBC_COMP, " GBC DKC Tilemaps"          },
+    {       DKL_COMP, " GB  DKL/DKL2/DKL3 Tilemaps"},
+    {  GBA_LZ77_COMP, " GBA BIOS LZ77 (10)"        },
+    {GBA_HUFF20_COMP, " GBA BIOS Huffman (20)"     },
+    {   GBA_RLE_COMP, " GBA BIOS RLE (30)"         },
+    {GBA_HUFF50_COMP, " GBA Huffman (50)"          },
+    {GBA_HUFF60_COMP, " GBA Huffman (60)"          },
+    {       GBA_COMP, " GBA BIOS Auto-Detect"      },
+    {GB_PRINTER_COMP, " GB  Printer"               }
+};
+static const int format_count = sizeof(formats) / sizeof(struct DK_ID);
+
+static int batch_decompress (struct BATCH_JOB *job) {
+    enum DK_FORMAT id = formats[job->format].id;
+    unsigned char *input, *output;
+    size_t input_size, output_size;
+    int e;
+    if (job->offset >= job->data_size)
+        return DK_ERROR_OFFSET_BIG;
+    input      = job->data + job->offset;
+    input_size = job->data_size - job->offset;
+    if ((e = dk_decompress_mem_to_mem_sized(id, &output, &output_size, input, input_size, &job->in_size)))
+        return e;
+    job->out_size = output_size;
+    e = batch_write(job->output, output, output_size);
+    free(output);
+    return e;
+}
+
+/* decompress through memory so the library can fill in the statistics */
+static int decompress_stats (
+    int format,
+    const char *file_out,
+    const char *file_in,
+    size_t offset
+) {
+    struct DK_STATS stats;
+    struct DK_OPTIONS opt;
+    unsigned char *input, *output;
+    size_t input_size, output_size;
+    int e;
 
-    if (fseek(f, 0, SEEK_END) == -1
-    || (len = ftell(f)) == -1u) {
-        fprintf(stderr, "Failed to seek output file. (size check)\n");
-        fclose(f);
-        return;
+    memset(&opt, 0, sizeof(struct DK_OPTIONS));
+    opt.stats = &stats;
+
+    if ((e = batch_read(file_in, &input, &input_size)))
+        return e;
+    if (offset >= input_size) {
+        free(input);
+        return DK_ERROR_OFFSET_BIG;
     }
-    fclose(f);
+    e = dk_decompress_mem_to_mem_opt(format, &output, &output_size, input + offset, input_size - offset, &opt);
+    free(input);
+    if (e)
+        return e;
+    e = batch_write(file_out, output, output_size);
+    free(output);
+    if (e)
+        return e;
 
-    printf("  Compressed size was %zd bytes.\n", compressed_size);
-    printf("Decompressed size  is %zd bytes.\n", len);
+    printf("Decompressed size  is %zd bytes.\n", output_size);
+    batch_stats(&stats);
+    return 0;
 }
 
 int main (int argc, char *argv[]) {
 
-    static const struct DK_ID {
-        enum DK_FORMAT id;
-        char *name;
-    } formats[] = {
-        {        BD_COMP, "SNES DKC2/DKC3 Big Data"    },
-        {        SD_COMP, "SNES DKC3 Small Data"       },
-        {    DKCCHR_COMP, "SNES DKC Tilesets"          },
-        {    DKCGBC_COMP, " GBC DKC Tilemaps"          },
-        {       DKL_COMP, " GB  DKL/DKL2/DKL3 Tilemaps"},
-        {  GBA_LZ77_COMP, " GBA BIOS LZ77 (10)"        },
-        {GBA_HUFF20_COMP, " GBA BIOS Huffman (20)"     },
-        {   GBA_RLE_COMP, " GBA BIOS RLE (30)"         },
-        {GBA_HUFF50_COMP, " GBA Huffman (50)"          },
-        {GBA_HUFF60_COMP, " GBA Huffman (60)"          },
-        {       GBA_COMP, " GBA BIOS Auto-Detect"      },
-        {GB_PRINTER_COMP, " GB  Printer"               }
-    };
-    static const int size = sizeof(formats) / sizeof(struct DK_ID);
-    int e, i, format = 0;
+    int e, i, format = 0, stats = 0;
     size_t offset;
-    size_t compressed_size = 0;
+    unsigned char *output = NULL;
+    size_t output_size = 0, compressed_size = 0;
+
+    if (argc >= 2 && !strcmp(argv[1], "--batch"))
+        return batch_main(argc, argv, 1, format_count, batch_decompress, NULL);
+
+    if (argc == 6 && !strcmp(argv[1], "--stats")) {
+        stats = 1;
+        argc--;
+        argv++;
+    }
 
     if (argc != 5) {
-        puts("Usage: ./decomp FORMAT OUTPUT INPUT POSITION\n\n"
+        puts("Usage: ./decomp [--stats] FORMAT OUTPUT INPUT POSITION\n"
+             "       ./decomp --batch MANIFEST [--threads NUM]\n\n"
+             "--stats reports what the decompressor did, if the library was built\n"
+             "with DKCOMP_STATS.\n\n"
+             "A manifest has one FORMAT OUTPUT INPUT POSITION per line, separated by tabs.\n"
+             "Use - to read it from stdin.\n\n"
              "Supported decompression formats:");
-        for (i = 0; i < size; i++)
+        for (i = 0; i < format_count; i++)
             printf("  %2d - %s\n", i, formats[i].name);
         return 1;
     }
 
     format = strtol(argv[1], NULL, 0);
-    if (format < 0 || format >= size) {
+    if (format < 0 || format >= format_count) {
         fprintf(stderr, "Unsupported decompression format.\n");
         return 1;
     }
 
     offset = strtol(argv[4], NULL, 0);
 
-    if ((e = dk_compressed_size_file(formats[format].id, argv[3], offset, &compressed_size))) {
-        fprintf(stderr, "Error: %s.\n", dk_get_error(e));
-        return 1;
+    if (stats) {
+        if ((e = decompress_stats(formats[format].id, argv[2], argv[3], offset))) {
+            fprintf(stderr, "Error: %s.\n", dk_get_error(e));
+            return 1;
+        }
+        return 0;
     }
 
-    if ((e = dk_decompress_file_to_file(formats[format].id, argv[2], argv[3], offset))) {
+    /* one pass gives us the data and both sizes */
+    if ((e = dk_decompress_file_to_mem_sized(formats[format].id, &output, &output_size, argv[3], offset, &compressed_size))
+    ||  (e = batch_write(argv[2], output, output_size))) {
         fprintf(stderr, "Error: %s.\n", dk_get_error(e));
+        free(output);
         return 1;
     }
+    free(output);
 
-    check_size(argv[2], compressed_size);
+    printf("  Compressed size was %zd bytes.\n", compressed_size);
+    printf("Decompressed size  is %zd bytes.\n", output_size);
     return 0;
 }
 
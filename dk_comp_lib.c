@@ -5,14 +5,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "dkcomp.h"
 #include "dk_internal.h"
 
 
-/* verify compressed data by decompressing and comparing */
-/* some formats pad input data which can make this fail */
-#define VERIFY_DATA 0
+
+/* Statistics */
+
+#if defined(DKCOMP_STATS)
+double stats_clock (void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+#endif
+
+/* take a copy of the caller's options and clear their statistics */
+static void open_options (struct COMPRESSOR *dk, const struct DK_OPTIONS *options) {
+    if (options == NULL)
+        return;
+    dk->opt = *options;
+    if (dk->opt.stats != NULL) {
+        memset(dk->opt.stats, 0, sizeof(struct DK_STATS));
+#if defined(DKCOMP_STATS)
+        dk->opt.stats->collected = 1;
+#endif
+    }
+}
 
 
 
@@ -95,30 +116,47 @@ static int open_output_buffer (unsigned char **output, size_t output_size) {
 }
 
 
-#if VERIFY_DATA
+/* Small Data stores its size in words, so it can only */
+/* give back a whole number of them                    */
+static size_t padded_size (enum DK_FORMAT comp_type, size_t size) {
+    if (comp_type == SD_COMP)
+        return size + (size & 1);
+    return size;
+}
+
 /* verify compressed data by decompressing it and comparing */
-static int verify_data (enum DK_FORMAT comp_type, struct COMPRESSOR *cmp) {
+int dk_verify (
+    enum DK_FORMAT comp_type,
+    unsigned char *compressed,
+    size_t compressed_size,
+    unsigned char *original,
+    size_t original_size
+) {
     unsigned char *data = NULL;
     size_t size = 0;
-    if (dk_decompress_mem_to_mem(comp_type, &data, &size, cmp->out.data, cmp->out.pos))
+    if (check_input_mem(original))
+        return DK_ERROR_NULL_INPUT;
+    if (dk_decompress_mem_to_mem(comp_type, &data, &size, compressed, compressed_size))
         return DK_ERROR_VERIFY_DEC;
-    if (size != cmp->in.length) {
+    if (size != original_size && size != padded_size(comp_type, original_size)) {
         free(data);
         return DK_ERROR_VERIFY_SIZE;
     }
-    if (memcmp(data, cmp->in.data, size)) {
+    if (memcmp(data, original, original_size)) {
         free(data);
         return DK_ERROR_VERIFY_DATA;
     }
     free(data);
     return 0;
 }
-#endif
 
 /* we initially allocate more than needed */
 /* here we reduce the allocate size to the output size */
 static void shrink_buffer (unsigned char **data, size_t size) {
-    unsigned char *d = realloc(*data, size);
+    unsigned char *d;
+    if (!size) /* (realloc might free it) */
+        return;
+    d = realloc(*data, size);
     if (d != NULL) *data = d;
 }
 
@@ -128,25 +166,19 @@ static void shrink_buffer (unsigned char **data, size_t size) {
 
 /* Check whether a compressor is supported */
 
-struct COMP_TYPE {
-    unsigned size_limit; /* 1 << n */
-    int (  *comp)(struct COMPRESSOR*);
-    int (*decomp)(struct COMPRESSOR*);
-};
-
-static const struct COMP_TYPE comp_table[] = {
-    [        BD_COMP] = { 16,        bd_compress,        bd_decompress },
-    [        SD_COMP] = { 16,        sd_compress,        sd_decompress },
-    [    DKCCHR_COMP] = { 16,    dkcchr_compress,    dkcchr_decompress },
-    [    DKCGBC_COMP] = { 12,    dkcgbc_compress,    dkcgbc_decompress },
-    [       DKL_COMP] = { 16,       dkl_compress,       dkl_decompress },
-    [  GBA_LZ77_COMP] = { 24,   gbalz77_compress,   gbalz77_decompress },
-    [GBA_HUFF20_COMP] = { 24, gbahuff20_compress, gbahuff20_decompress },
-    [   GBA_RLE_COMP] = { 24,    gbarle_compress,    gbarle_decompress },
-    [GBA_HUFF50_COMP] = { 24, gbahuff50_compress, gbahuff50_decompress },
-    [GBA_HUFF60_COMP] = { 24, gbahuff60_compress, gbahuff60_decompress },
-    [       GBA_COMP] = { 24,               NULL,       gba_decompress },
-    [GB_PRINTER_COMP] = { 10, gbprinter_compress, gbprinter_decompress }
+const struct COMP_TYPE comp_table[COMP_LIMIT] = {
+    [        BD_COMP] = { 16,        bd_compress,        bd_decompress, NULL,                 bd_probe, 1 },
+    [        SD_COMP] = { 16,        sd_compress,        sd_decompress, sd_size,              sd_probe, 0 },
+    [    DKCCHR_COMP] = { 16,    dkcchr_compress,    dkcchr_decompress, NULL,             dkcchr_probe, 1 },
+    [    DKCGBC_COMP] = { 12,    dkcgbc_compress,    dkcgbc_decompress, NULL,             dkcgbc_probe, 1 },
+    [       DKL_COMP] = { 16,       dkl_compress,       dkl_decompress, NULL,                dkl_probe, 1 },
+    [  GBA_LZ77_COMP] = { 24,   gbalz77_compress,   gbalz77_decompress, gbalz77_size,    gbalz77_probe, 1 },
+    [GBA_HUFF20_COMP] = { 24, gbahuff20_compress, gbahuff20_decompress, gbahuff20_size, gbahuff20_probe, 0 },
+    [   GBA_RLE_COMP] = { 24,    gbarle_compress,    gbarle_decompress, gbarle_size,      gbarle_probe, 1 },
+    [GBA_HUFF50_COMP] = { 24, gbahuff50_compress, gbahuff50_decompress, gbahuff50_size, gbahuff50_probe, 0 },
+    [GBA_HUFF60_COMP] = { 24, gbahuff60_compress, gbahuff60_decompress, gbahuff60_size, gbahuff60_probe, 0 },
+    [       GBA_COMP] = { 24,               NULL,       gba_decompress, gba_size,            gba_probe, 0 },
+    [GB_PRINTER_COMP] = { 10, gbprinter_compress, gbprinter_decompress, NULL,          gbprinter_probe, 1 }
 };
 
 
@@ -180,14 +212,72 @@ static int get_compressor (
 
 
 
+/* formats that store the decompressed size in their header get a */
+/* buffer of exactly that size, everything else gets the maximum */
+static int open_decomp_buffer (
+    const struct COMP_TYPE *dk_decompress,
+    struct COMPRESSOR *dc
+) {
+    size_t size;
+    enum DK_ERROR e;
+
+    dc->out.limit = 1 << dk_decompress->size_limit;
+
+    if (dk_decompress->size != NULL) {
+        if ((e = dk_decompress->size(dc, &size)))
+            return e;
+        if (dc->out.limit > size)
+            dc->out.limit = size;
+    }
+
+    /* (calloc might not like a zero size) */
+    return open_output_buffer(&dc->out.data, dc->out.limit ? dc->out.limit : 1);
+}
+
+
+
+
 /* Compression handlers */
 
-int dk_compress_mem_to_mem (
+size_t dk_compress_limit (enum DK_FORMAT comp_type) {
+    const struct COMP_TYPE *dk_compress;
+    if (get_compressor(comp_type, 1, 0, &dk_compress))
+        return 0;
+    return (size_t)1 << dk_compress->size_limit;
+}
+
+int dk_probe (
+    enum DK_FORMAT decomp_type,
+    unsigned char *input,
+    size_t input_size,
+    int *score
+) {
+    enum DK_ERROR e;
+    const struct COMP_TYPE *dk_decompress;
+    struct COMPRESSOR dc;
+
+    if (score == NULL)
+        return DK_ERROR_NULL_INPUT;
+    *score = 0;
+    if ((e = get_compressor(decomp_type, 0, 0, &dk_decompress))
+    ||  (e = check_input_mem(input)))
+        return e;
+
+    memset(&dc, 0, sizeof(struct COMPRESSOR));
+    dc.in.data   = input;
+    dc.in.length = input_size;
+    *score = dk_decompress->probe(&dc);
+    return 0;
+}
+
+static int compress_mem (
     enum DK_FORMAT comp_type,
     unsigned char **output,
     size_t *output_size,
     unsigned char *input,
-    size_t input_size
+    size_t input_size,
+    const struct DK_OPTIONS *options,
+    struct DK_PARSE *parse
 ) {
     enum DK_ERROR e;
     const struct COMP_TYPE *dk_compress;
@@ -195,6 +285,8 @@ int dk_compress_mem_to_mem (
     memset(&cmp, 0, sizeof(struct COMPRESSOR));
     *output      = NULL;
     *output_size = 0;
+    open_options(&cmp, options);
+    cmp.parse = parse;
 
     if ((e = get_compressor(comp_type, 1, input_size, &dk_compress))
     ||  (e = check_input_mem(input)))
@@ -207,10 +299,15 @@ int dk_compress_mem_to_mem (
     if ((e = open_output_buffer(&cmp.out.data, cmp.out.limit))
     ||  (e = dk_compress->comp(&cmp)))
         goto error;
-#if VERIFY_DATA
-    if ((e = verify_data(comp_type, &cmp)))
+
+    /* not every compressor can tell early, so check the result too */
+    if (OVER_BUDGET(&cmp, cmp.out.pos)) {
+        e = DK_ERROR_BUDGET;
+        goto error;
+    }
+    if (cmp.opt.verify
+    && (e = dk_verify(comp_type, cmp.out.data, cmp.out.pos, input, input_size)))
         goto error;
-#endif
 
     shrink_buffer(&cmp.out.data, cmp.out.pos);
     *output      = cmp.out.data;
@@ -221,6 +318,140 @@ error:
     return e;
 }
 
+int dk_compress_mem_to_mem_opt (
+    enum DK_FORMAT comp_type,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options
+) {
+    return compress_mem(
+        comp_type, output, output_size, input, input_size, options, NULL
+    );
+}
+
+/* forget everything, but keep the struct around for next time */
+static void parse_clear (struct DK_PARSE *parse) {
+    free(parse->input);
+    path_free(&parse->path[0]);
+    path_free(&parse->path[1]);
+    memset(parse, 0, sizeof(struct DK_PARSE));
+}
+
+void dk_parse_free (struct DK_PARSE *parse) {
+    if (parse == NULL)
+        return;
+    parse_clear(parse);
+    free(parse);
+}
+
+/* compress, reusing whatever the last call parsed before the first */
+/* byte that changed. the output is the same as a full compression. */
+int dk_compress_incremental (
+    enum DK_FORMAT comp_type,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options,
+    struct DK_PARSE **parse
+) {
+    struct DK_PARSE *p;
+    enum DK_ERROR e;
+
+    if (parse == NULL)
+        return DK_ERROR_NULL_INPUT;
+    if ((p = *parse) == NULL) {
+        if ((p = calloc(1, sizeof(struct DK_PARSE))) == NULL)
+            return DK_ERROR_ALLOC;
+        *parse = p;
+    }
+
+    /* how much of the input is the same as last time */
+    p->edit = 0;
+    if (input != NULL && p->input != NULL
+    &&  p->format == comp_type && p->length == input_size)
+        while (p->edit < input_size && p->input[p->edit] == input[p->edit])
+            p->edit++;
+
+    if ((e = compress_mem(comp_type, output, output_size, input, input_size, options, p))) {
+        parse_clear(p);
+        return e;
+    }
+
+    /* keep a copy to compare the next input with */
+    if (p->input == NULL || p->length != input_size) {
+        free(p->input);
+        if ((p->input = malloc(input_size ? input_size : 1)) == NULL) {
+            parse_clear(p); /* (the output is still fine) */
+            return 0;
+        }
+    }
+    memcpy(p->input, input, input_size);
+    p->format = comp_type;
+    p->length = input_size;
+    return 0;
+}
+
+/* run the parse without writing anything, if the compressor can */
+int dk_compressed_size_estimate (
+    enum DK_FORMAT comp_type,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options,
+    size_t *compressed_size
+) {
+    enum DK_ERROR e;
+    const struct COMP_TYPE *dk_compress;
+    struct COMPRESSOR cmp;
+    unsigned char *output;
+
+    if (compressed_size == NULL)
+        return DK_ERROR_NULL_INPUT;
+    *compressed_size = 0;
+
+    if ((e = get_compressor(comp_type, 1, input_size, &dk_compress))
+    ||  (e = check_input_mem(input)))
+        return e;
+
+    /* otherwise the output is just thrown away */
+    if (!dk_compress->dry_run) {
+        if ((e = dk_compress_mem_to_mem_opt(comp_type, &output, compressed_size, input, input_size, options)))
+            return e;
+        free(output);
+        return 0;
+    }
+
+    memset(&cmp, 0, sizeof(struct COMPRESSOR));
+    open_options(&cmp, options);
+    cmp.in.data   = input;
+    cmp.in.length = input_size;
+    cmp.out.limit = 1 << dk_compress->size_limit;
+    cmp.dry_run   = 1;
+
+    if ((e = dk_compress->comp(&cmp)))
+        return e;
+    if (OVER_BUDGET(&cmp, cmp.out.pos))
+        return DK_ERROR_BUDGET;
+    if (cmp.out.pos > cmp.out.limit) /* (where writing would have failed) */
+        return DK_ERROR_OOB_OUTPUT_W;
+    *compressed_size = cmp.out.pos;
+    return 0;
+}
+
+int dk_compress_mem_to_mem (
+    enum DK_FORMAT comp_type,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size
+) {
+    return dk_compress_mem_to_mem_opt(
+        comp_type, output, output_size, input, input_size, NULL
+    );
+}
+
 int dk_compress_file_to_mem (
     enum DK_FORMAT comp_type,
     unsigned char **output,
@@ -239,10 +470,6 @@ int dk_compress_file_to_mem (
     if ((e = open_output_buffer(&cmp.out.data, cmp.out.limit))
     ||  (e = dk_compress->comp(&cmp)))
         goto error;
-#if VERIFY_DATA
-    if (e = verify_data(comp_type, &cmp))
-        goto error;
-#endif
 
     free(cmp.in.data); cmp.in.data = NULL;
     shrink_buffer(&cmp.out.data, cmp.out.pos);
@@ -298,19 +525,35 @@ int dk_compress_file_to_file (
 
 /* Decompression handlers */
 
-int dk_decompress_mem_to_mem (
+/* how much input the decompressor used */
+void adjust_compressed_size (
+    enum DK_FORMAT decomp_type,
+    struct COMPRESSOR *dc,
+    size_t *compressed_size
+) {
+    if ((decomp_type == DKL_COMP && !dc->in.bitpos)
+    ||  dc->in.bitpos)
+        dc->in.pos += 1;
+    *compressed_size = dc->in.pos;
+}
+
+static int decompress_mem (
     enum DK_FORMAT decomp_type,
     unsigned char **output,
     size_t *output_size,
     unsigned char *input,
-    size_t input_size
+    size_t input_size,
+    size_t *compressed_size,
+    const struct DK_OPTIONS *options
 ) {
     enum DK_ERROR e;
     const struct COMP_TYPE *dk_decompress;
     struct COMPRESSOR dc;
+    double t;
     memset(&dc, 0, sizeof(struct COMPRESSOR));
     *output      = NULL;
     *output_size = 0;
+    open_options(&dc, options);
 
     if ((e = get_compressor(decomp_type, 0, 0, &dk_decompress))
     ||  (e = check_input_mem(input)))
@@ -318,12 +561,15 @@ int dk_decompress_mem_to_mem (
 
     dc.in.data   = input;
     dc.in.length = input_size;
-    dc.out.limit = 1 << dk_decompress->size_limit;
 
-    if ((e = open_output_buffer(&dc.out.data, dc.out.limit))
-    ||  (e = dk_decompress->decomp(&dc)))
+    if ((e = open_decomp_buffer(dk_decompress, &dc)))
         goto error;
-    shrink_buffer(&dc.out.data, dc.out.limit);
+    t = stats_start(&dc);
+    if ((e = dk_decompress->decomp(&dc)))
+        goto error;
+    stats_phase(&dc, DK_PHASE_EMIT, &t);
+    adjust_compressed_size(decomp_type, &dc, compressed_size);
+    shrink_buffer(&dc.out.data, dc.out.pos);
     *output      = dc.out.data;
     *output_size = dc.out.pos;
     return 0;
@@ -332,12 +578,53 @@ error:
     return e;
 }
 
-int dk_decompress_file_to_mem (
+int dk_decompress_mem_to_mem_sized (
+    enum DK_FORMAT decomp_type,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    size_t *compressed_size
+) {
+    return decompress_mem(
+        decomp_type, output, output_size, input, input_size, compressed_size, NULL
+    );
+}
+
+int dk_decompress_mem_to_mem_opt (
+    enum DK_FORMAT decomp_type,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options
+) {
+    size_t compressed_size;
+    return decompress_mem(
+        decomp_type, output, output_size, input, input_size, &compressed_size, options
+    );
+}
+
+int dk_decompress_mem_to_mem (
+    enum DK_FORMAT decomp_type,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size
+) {
+    size_t compressed_size;
+    return dk_decompress_mem_to_mem_sized(
+        decomp_type, output, output_size, input, input_size, &compressed_size
+    );
+}
+
+int dk_decompress_file_to_mem_sized (
     enum DK_FORMAT decomp_type,
     unsigned char **output,
     size_t *output_size,
     const char *file_in,
-    size_t position
+    size_t position,
+    size_t *compressed_size
 ) {
     enum DK_ERROR e;
     const struct COMP_TYPE *dk_decompress;
@@ -348,14 +635,13 @@ int dk_decompress_file_to_mem (
     ||  (e = open_input_file(file_in, &dc.in.data, &dc.in.length, position, 0)))
         goto error;
 
-    dc.out.limit = 1 << dk_decompress->size_limit;
-
-    if ((e = open_output_buffer(&dc.out.data, dc.out.limit))
+    if ((e = open_decomp_buffer(dk_decompress, &dc))
     ||  (e = dk_decompress->decomp(&dc)))
         goto error;
 
+    adjust_compressed_size(decomp_type, &dc, compressed_size);
     free(dc.in.data); dc.in.data = NULL;
-    shrink_buffer(&dc.out.data, dc.out.limit);
+    shrink_buffer(&dc.out.data, dc.out.pos);
     *output      = dc.out.data;
     *output_size = dc.out.pos;
     return 0;
@@ -365,6 +651,19 @@ error:
     return e;
 }
 
+int dk_decompress_file_to_mem (
+    enum DK_FORMAT decomp_type,
+    unsigned char **output,
+    size_t *output_size,
+    const char *file_in,
+    size_t position
+) {
+    size_t compressed_size;
+    return dk_decompress_file_to_mem_sized(
+        decomp_type, output, output_size, file_in, position, &compressed_size
+    );
+}
+
 int dk_decompress_mem_to_file (
     enum DK_FORMAT decomp_type,
     const char *file_out,
@@ -410,48 +709,23 @@ int dk_decompress_file_to_file (
 /* size functions */
 /* use these to determine the compressed size of the compressed data */
 
-static void adjust_compressed_size (
-    enum DK_FORMAT decomp_type,
-    struct COMPRESSOR *dc,
-    size_t *compressed_size
-) {
-    if ((decomp_type == DKL_COMP && !dc->in.bitpos)
-    ||  dc->in.bitpos)
-        dc->in.pos += 1;
-    *compressed_size = dc->in.pos;
-}
-
 /* get the size of the compressed data */
+/* (this still has to decompress everything to find out) */
 int dk_compressed_size_mem (
     enum DK_FORMAT decomp_type,
     unsigned char *input,
     size_t input_size,
     size_t *compressed_size
 ) {
+    unsigned char *output;
+    size_t output_size;
     enum DK_ERROR e;
-    const struct COMP_TYPE *dk_decompress;
-    struct COMPRESSOR dc;
-    memset(&dc, 0, sizeof(struct COMPRESSOR));
-
-    if ((e = get_compressor(decomp_type, 0, 0, &dk_decompress))
-    ||  (e = check_input_mem(input)))
-        goto error;
-
-    dc.in.data   = input;
-    dc.in.length = input_size;
-    dc.out.limit = 1 << dk_decompress->size_limit;
-
-    if ((e = open_output_buffer(&dc.out.data, dc.out.limit))
-    ||  (e = dk_decompress->decomp(&dc)))
-        goto error;
-    free(dc.out.data); dc.out.data = NULL;
-
-    adjust_compressed_size(decomp_type, &dc, compressed_size);
+    if ((e = dk_decompress_mem_to_mem_sized(
+        decomp_type, &output, &output_size, input, input_size, compressed_size
+    )))
+        return e;
+    free(output);
     return 0;
-error:
-    free(dc.out.data); dc.out.data = NULL;
-    return e;
-
 }
 
 int dk_compressed_size_file (
@@ -460,28 +734,14 @@ int dk_compressed_size_file (
     size_t position,
     size_t *compressed_size
 ) {
+    unsigned char *output;
+    size_t output_size;
     enum DK_ERROR e;
-    const struct COMP_TYPE *dk_decompress;
-    struct COMPRESSOR dc;
-    memset(&dc, 0, sizeof(struct COMPRESSOR));
-
-    if ((e = get_compressor(decomp_type, 0, 0, &dk_decompress))
-    ||  (e = open_input_file(file_in, &dc.in.data, &dc.in.length, position, 0)))
-        goto error;
-
-    dc.out.limit = 1 << dk_decompress->size_limit;
-
-    if ((e = open_output_buffer(&dc.out.data, dc.out.limit))
-    ||  (e = dk_decompress->decomp(&dc)))
-        goto error;
-    free(dc. in.data); dc. in.data = NULL;
-    free(dc.out.data); dc.out.data = NULL;
-
-    adjust_compressed_size(decomp_type, &dc, compressed_size);
+    if ((e = dk_decompress_file_to_mem_sized(
+        decomp_type, &output, &output_size, file_in, position, compressed_size
+    )))
+        return e;
+    free(output);
     return 0;
-error:
-    free(dc. in.data); dc. in.data = NULL;
-    free(dc.out.data); dc.out.data = NULL;
-    return e;
 }
 
@@ -58,6 +58,10 @@ static const char *dk_error_messages[] = {
     [DK_ERROR_VERIFY_SIZE]  = "The size of the decompressed data doesn't match the original",
     [DK_ERROR_VERIFY_DATA]  = "The decompressed data doesn't match the original data",
 
+    [DK_ERROR_BUDGET]       = "The compressed data would exceed the requested size",
+    [DK_ERROR_CANCELLED]    = "Cancelled by the caller",
+    [DK_ERROR_INDEX_WRONG]  = "The index doesn't belong to this data",
+
     [DK_ERROR_INVALID]      = "An invalid error code was passed to this function"
 };
 
@@ -6,67 +6,10 @@
 #define DK_INTERNAL
 
 #include <stddef.h>
+#include <stdint.h>
 #define BUILD_DKCOMP
 #include "dkcomp.h"
 
-enum DK_ERROR {
-    DK_SUCCESS,
-
-    DK_ERROR_OOB_INPUT,
-    DK_ERROR_OOB_OUTPUT_R,
-    DK_ERROR_OOB_OUTPUT_W,
-
-    DK_ERROR_ALLOC,
-
-    DK_ERROR_NULL_INPUT,
-    DK_ERROR_FILE_INPUT,
-    DK_ERROR_FILE_OUTPUT,
-    DK_ERROR_SEEK_INPUT,
-    DK_ERROR_FREAD,
-    DK_ERROR_FWRITE,
-
-    DK_ERROR_OFFSET_BIG,
-    DK_ERROR_OFFSET_NEG,
-    DK_ERROR_OFFSET_DIFF,
-
-    DK_ERROR_INPUT_SMALL,
-    DK_ERROR_INPUT_LARGE,
-    DK_ERROR_OUTPUT_SMALL,
-
-    DK_ERROR_SIZE_WRONG,
-    DK_ERROR_EARLY_EOF,
-
-    DK_ERROR_BAD_FORMAT,
-    DK_ERROR_GBA_DETECT,
-    DK_ERROR_SIG_WRONG,
-
-    DK_ERROR_COMP_NOT,
-    DK_ERROR_DECOMP_NOT,
-
-    DK_ERROR_SD_BAD_EXIT,
-    DK_ERROR_LZ77_HIST,
-    DK_ERROR_HUFF_WRONG,
-    DK_ERROR_HUFF_LEAF,
-    DK_ERROR_HUFF_DIST,
-    DK_ERROR_HUFF_NO_LEAF,
-    DK_ERROR_HUFF_OUTSIZE,
-    DK_ERROR_HUFF_STACKS,
-    DK_ERROR_HUFF_NODES,
-    DK_ERROR_HUFF_NODELIM,
-    DK_ERROR_HUFF_LEAFVAL,
-
-    DK_ERROR_TABLE_RANGE,
-    DK_ERROR_TABLE_VALUE,
-    DK_ERROR_TABLE_ZERO,
-
-    DK_ERROR_VERIFY_DEC,
-    DK_ERROR_VERIFY_SIZE,
-    DK_ERROR_VERIFY_DATA,
-
-    DK_ERROR_INVALID,
-    DK_ERROR_LIMIT
-};
-
 struct FILE_STREAM {
     unsigned char *data;
     size_t length;
@@ -79,7 +22,154 @@ struct FILE_STREAM {
 struct COMPRESSOR {
     struct FILE_STREAM in;
     struct FILE_STREAM out;
+    struct DK_OPTIONS opt; /* zeroed if the caller didn't supply any */
+    int dry_run;           /* stop once the size is known, leaving it in */
+                           /* out.pos (out.data is NULL, see COMP_TYPE)  */
+    struct DK_PARSE *parse; /* from dk_compress_incremental, or NULL */
+    size_t poll_next;       /* dk_poll calls back once done reaches this */
+};
+
+/* streaming decompression state (see dk_stream.c) */
+struct DK_STREAM {
+    struct COMPRESSOR dc; /* out is the caller's buffer for each read */
+    size_t size;          /* decompressed size from the header */
+    size_t done;          /* how much of it has been produced so far */
+    int error;            /* sticky, once something goes wrong */
+    int (*read)(struct DK_STREAM*); /* fill dc.out as far as possible */
+    void *state;          /* decoder specific, freed with the stream */
+};
+
+/* would an output of this many bytes exceed the caller's budget? */
+#define OVER_BUDGET(dk, size) ((dk)->opt.budget && (size) > (dk)->opt.budget)
+
+/* check in with the caller every so often, nonzero if they want us to stop */
+/* (some loops advance by more than one position, so done is compared    */
+/* against a threshold rather than tested for a multiple of the interval) */
+#define POLL_INTERVAL 256
+static inline int dk_poll (struct COMPRESSOR *dk, size_t done, size_t total) {
+    if (dk->opt.progress == NULL || done < dk->poll_next)
+        return 0;
+    dk->poll_next = done + (dk->opt.poll_interval ? dk->opt.poll_interval : POLL_INTERVAL);
+    return dk->opt.progress(dk->opt.progress_data, done, total);
+}
+
+/* optimal parse path shared by the compressors (see dk_path.c) */
+/* nodes are split across three arrays, 10 bytes each in total, */
+/* so the relaxation loops only need to touch the costs         */
+struct DK_PATH {
+    uint32_t  *cost; /* cheapest known way to get here          */
+    uint32_t *ncase; /* the case that got here, packed per codec */
+    uint16_t   *len; /* length of the step that got here, or the */
+                     /* one leaving here after path_reverse      */
+    size_t length;   /* input length, so there are length+1 nodes */
+#if defined(DKCOMP_STATS)
+    size_t tests;    /* path_test calls, see stats_path */
+#endif
+};
+#define PATH_UNSEEN 0xFFFFFFFFu
+
+int      path_init    (struct DK_PATH*, size_t length);
+void     path_clear   (struct DK_PATH*);
+int      path_reverse (struct DK_PATH*);
+uint32_t path_least   (const struct DK_PATH*, size_t i, size_t w);
+void     path_free    (struct DK_PATH*);
+int      path_save    (const struct DK_PATH*, struct DK_PATH *saved);
+size_t   path_resume  (struct DK_PATH*, const struct DK_PATH *saved,
+                       size_t edit, size_t reach);
+
+/* what dk_compress_incremental keeps between calls. compressors that */
+/* support it save their parse before following it back, so the next */
+/* call can pick it up again from just before the first changed byte */
+struct DK_PARSE {
+    enum DK_FORMAT format;
+    unsigned char *input; /* a copy of the last input */
+    size_t length;
+    size_t edit;          /* the first byte that differs from it */
+    struct DK_PATH path[2];     /* one per pass (Big Data has two) */
+    unsigned char rle[2];       /* the constants Big Data's passes used */
+    unsigned char header[0x27]; /* (the first only looks up RLE ones)   */
+};
+
+/* take the step from i to i+len if it's cheaper than what we have */
+static inline void path_test (
+    struct DK_PATH *path,
+    size_t i,
+    size_t len,
+    uint32_t cost,
+    uint32_t ncase
+) {
+#if defined(DKCOMP_STATS)
+    path->tests++;
+#endif
+    if (path->cost[i+len] > cost) {
+        path->cost [i+len] = cost;
+        path->ncase[i+len] = ncase;
+        path->len  [i+len] = len;
+    }
+}
+
+/* statistics for the caller (see DK_STATS) */
+/* without DKCOMP_STATS these do nothing and cost nothing */
+#if defined(DKCOMP_STATS)
+double stats_clock (void);
+static inline void stats_case (struct COMPRESSOR *dk, unsigned ncase, size_t bytes) {
+    if (dk->opt.stats != NULL && ncase < DK_STATS_CASES) {
+        dk->opt.stats->cases[ncase].count++;
+        dk->opt.stats->cases[ncase].bytes += bytes;
+    }
+}
+static inline void stats_probe (struct COMPRESSOR *dk) {
+    if (dk->opt.stats != NULL)
+        dk->opt.stats->probes++;
+}
+static inline void stats_slow (struct COMPRESSOR *dk) {
+    if (dk->opt.stats != NULL)
+        dk->opt.stats->slow++;
+}
+static inline void stats_path (struct COMPRESSOR *dk, struct DK_PATH *path) {
+    if (dk->opt.stats != NULL)
+        dk->opt.stats->relaxations += path->tests;
+    path->tests = 0;
+}
+/* a phase ends at *t, and the next one starts there */
+static inline double stats_start (struct COMPRESSOR *dk) {
+    return (dk->opt.stats != NULL) ? stats_clock() : 0;
+}
+static inline void stats_phase (struct COMPRESSOR *dk, enum DK_PHASE phase, double *t) {
+    if (dk->opt.stats != NULL) {
+        double now = stats_clock();
+        dk->opt.stats->seconds[phase] += now - *t;
+        *t = now;
+    }
+}
+#else
+static inline void stats_case (struct COMPRESSOR *dk, unsigned ncase, size_t bytes) {
+    (void)dk; (void)ncase; (void)bytes;
+}
+static inline void stats_probe (struct COMPRESSOR *dk) { (void)dk; }
+static inline void stats_slow  (struct COMPRESSOR *dk) { (void)dk; }
+static inline void stats_path (struct COMPRESSOR *dk, struct DK_PATH *path) {
+    (void)dk; (void)path;
+}
+static inline double stats_start (struct COMPRESSOR *dk) { (void)dk; return 0; }
+static inline void stats_phase (struct COMPRESSOR *dk, enum DK_PHASE phase, double *t) {
+    (void)dk; (void)phase; (void)t;
+}
+#endif
+
+/* every format's (de)compressor, indexed by DK_FORMAT (see dk_comp_lib.c) */
+struct COMP_TYPE {
+    unsigned size_limit; /* 1 << n */
+    int (  *comp)(struct COMPRESSOR*);
+    int (*decomp)(struct COMPRESSOR*);
+    int (  *size)(struct COMPRESSOR*, size_t*); /* size from header */
+    int ( *probe)(struct COMPRESSOR*); /* header check, 0-100 */
+    int dry_run; /* comp supports COMPRESSOR.dry_run */
 };
+extern const struct COMP_TYPE comp_table[COMP_LIMIT];
+
+/* after decompressing, how much input the compressed data took up */
+void adjust_compressed_size (enum DK_FORMAT, struct COMPRESSOR*, size_t*);
 
 int          bd_compress (struct COMPRESSOR*);
 int        bd_decompress (struct COMPRESSOR*);
@@ -105,6 +195,45 @@ int       gba_decompress (struct COMPRESSOR*);
 int   gbprinter_compress (struct COMPRESSOR*);
 int gbprinter_decompress (struct COMPRESSOR*);
 
+/* decompressed size for formats that store it in their header */
+int              sd_size (struct COMPRESSOR*, size_t*);
+int         gbalz77_size (struct COMPRESSOR*, size_t*);
+int          gbarle_size (struct COMPRESSOR*, size_t*);
+int       gbahuff20_size (struct COMPRESSOR*, size_t*);
+int       gbahuff50_size (struct COMPRESSOR*, size_t*);
+int       gbahuff60_size (struct COMPRESSOR*, size_t*);
+int             gba_size (struct COMPRESSOR*, size_t*);
+
+/* how likely the input is to start with each format, judging only by */
+/* its first few bytes. 0 means it can't be, higher is more confident. */
+int             bd_probe (struct COMPRESSOR*);
+int             sd_probe (struct COMPRESSOR*);
+int         dkcchr_probe (struct COMPRESSOR*);
+int         dkcgbc_probe (struct COMPRESSOR*);
+int            dkl_probe (struct COMPRESSOR*);
+int        gbalz77_probe (struct COMPRESSOR*);
+int      gbahuff20_probe (struct COMPRESSOR*);
+int         gbarle_probe (struct COMPRESSOR*);
+int      gbahuff50_probe (struct COMPRESSOR*);
+int      gbahuff60_probe (struct COMPRESSOR*);
+int            gba_probe (struct COMPRESSOR*);
+int      gbprinter_probe (struct COMPRESSOR*);
+
+/* set up streaming decompression (fills in read, state and size) */
+int       gbalz77_stream (struct DK_STREAM*);
+int        gbarle_stream (struct DK_STREAM*);
+int     gbahuff20_stream (struct DK_STREAM*);
+int     gbahuff50_stream (struct DK_STREAM*);
+int     gbahuff60_stream (struct DK_STREAM*);
+int           gba_stream (struct DK_STREAM*);
+
+/* random access, see dk_index_create */
+int        gbalz77_index (struct DK_STREAM*, size_t interval,
+                          unsigned char **index, size_t *index_size);
+int   gbalz77_index_read (struct DK_STREAM*, const unsigned char *index,
+                          size_t index_size, size_t offset,
+                          unsigned char *output, size_t output_size);
+
 const char *dk_get_error (int);
 
 #endif
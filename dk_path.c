@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - optimal parse path */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dk_internal.h"
+
+int path_init (struct DK_PATH *path, size_t length) {
+    size_t nodes = length+1;
+    unsigned char *block = malloc(nodes * (2*sizeof(uint32_t) + sizeof(uint16_t)));
+    if (block == NULL)
+        return DK_ERROR_ALLOC;
+    path->cost   = (uint32_t*) block;
+    path->ncase  = (uint32_t*)(block + nodes*sizeof(uint32_t));
+    path->len    = (uint16_t*)(block + nodes*sizeof(uint32_t)*2);
+    path->length = length;
+#if defined(DKCOMP_STATS)
+    path->tests  = 0;
+#endif
+    path_clear(path);
+    return 0;
+}
+
+void path_clear (struct DK_PATH *path) {
+    size_t i;
+    for (i = 0; i <= path->length; i++) {
+        path->cost [i] = PATH_UNSEEN;
+        path->ncase[i] = 0;
+        path->len  [i] = 0;
+    }
+    path->cost[0] = 0;
+}
+
+/* turn the lengths around so they can be followed from the start */
+/* returns nonzero if there's no path to the end */
+int path_reverse (struct DK_PATH *path) {
+    size_t i = path->length;
+    unsigned next = 0;
+    if (path->cost[i] == PATH_UNSEEN)
+        return 1;
+    while (i) {
+        unsigned len = path->len[i];
+        if (!len)
+            return 1;
+        path->len[i] = next;
+        next = len;
+        i -= len;
+    }
+    path->len[0] = next;
+    return 0;
+}
+
+/* cheapest of nodes i..i+w */
+/* if every path to the end passes through one of them, */
+/* this gives a lower bound for the final cost */
+uint32_t path_least (const struct DK_PATH *path, size_t i, size_t w) {
+    uint32_t least = PATH_UNSEEN;
+    size_t j;
+    for (j = i; j <= path->length && j <= i+w; j++)
+        if (least > path->cost[j])
+            least = path->cost[j];
+    return least;
+}
+
+void path_free (struct DK_PATH *path) {
+    free(path->cost);
+    path->cost = NULL;
+}
+
+/* keep a copy of the parse before path_reverse changes it */
+int path_save (const struct DK_PATH *path, struct DK_PATH *saved) {
+    size_t nodes = path->length+1;
+    if (saved->cost != NULL && saved->length != path->length)
+        path_free(saved);
+    if (saved->cost == NULL && path_init(saved, path->length))
+        return DK_ERROR_ALLOC;
+    memcpy(saved->cost,  path->cost,  nodes * sizeof(uint32_t));
+    memcpy(saved->ncase, path->ncase, nodes * sizeof(uint32_t));
+    memcpy(saved->len,   path->len,   nodes * sizeof(uint16_t));
+    return 0;
+}
+
+/* pick up a saved parse of an input that's the same before edit.      */
+/* if no case at i reads or steps past i+reach, the nodes up to        */
+/* edit-reach were settled without looking at the edit, so they're    */
+/* copied and the rest are left clear. the steps that can reach past  */
+/* them are taken again, which gives the same ties as a full search.  */
+/* path should be clear, returns where the search should start from.  */
+size_t path_resume (
+    struct DK_PATH *path,
+    const struct DK_PATH *saved,
+    size_t edit,
+    size_t reach
+) {
+    size_t from;
+    if (saved->cost == NULL || saved->length != path->length || edit < 2*reach)
+        return 0;
+    from = edit - reach;
+    memcpy(path->cost,  saved->cost,  (from+1) * sizeof(uint32_t));
+    memcpy(path->ncase, saved->ncase, (from+1) * sizeof(uint32_t));
+    memcpy(path->len,   saved->len,   (from+1) * sizeof(uint16_t));
+    return from - reach;
+}
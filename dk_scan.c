@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - finding compressed data in ROM images */
+
+/* almost every offset in a ROM is not the start of compressed data, so */
+/* each format gets a cheap look at its header first and only the ones */
+/* that pass are decoded. every attempt decodes into the same buffer,   */
+/* which only needs clearing as far as the last attempt wrote to it.    */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dkcomp.h"
+#include "dk_internal.h"
+
+#define SCAN_MIN_OUTPUT 16
+#define SCAN_MAX_OUTPUT 0x40000
+
+/* formats tried when the caller doesn't list any. the rest have */
+/* little or no header, so their probes let most offsets through. */
+static const int scan_default[COMP_LIMIT] = {
+    [        BD_COMP] = 1,
+    [  GBA_LZ77_COMP] = 1,
+    [GBA_HUFF20_COMP] = 1,
+    [   GBA_RLE_COMP] = 1,
+    [GBA_HUFF50_COMP] = 1,
+    [GBA_HUFF60_COMP] = 1
+};
+
+struct SCAN {
+    unsigned char *input;
+    size_t input_size;
+    size_t min_output, max_output;
+    unsigned char *buffer; /* zeroed, apart from during an attempt */
+    struct DK_SCAN_RESULT *results;
+    size_t count, size;
+};
+
+/* cheap checks that rule out most offsets without decoding anything */
+static int plausible (
+    struct SCAN *scan,
+    enum DK_FORMAT format,
+    struct COMPRESSOR *dc,
+    size_t *limit,
+    int *score
+) {
+    const struct COMP_TYPE *type = &comp_table[format];
+    size_t size;
+
+    if ((*score = type->probe(dc)) <= 0)
+        return 0;
+
+    *limit = (size_t)1 << type->size_limit;
+    if (*limit > scan->max_output)
+        *limit = scan->max_output;
+
+    /* formats with a size in their header must claim a sensible one */
+    if (type->size != NULL) {
+        if (type->size(dc, &size)
+        ||  size < scan->min_output
+        ||  size > *limit)
+            return 0;
+        *limit = size;
+        dc->in.pos = 0;
+    }
+    return 1;
+}
+
+static int add_result (struct SCAN *scan, struct DK_SCAN_RESULT *r) {
+    if (scan->count == scan->size) {
+        size_t size = scan->size ? scan->size * 2 : 64;
+        struct DK_SCAN_RESULT *d = realloc(scan->results, size * sizeof(struct DK_SCAN_RESULT));
+        if (d == NULL)
+            return DK_ERROR_ALLOC;
+        scan->results = d;
+        scan->size    = size;
+    }
+    scan->results[scan->count++] = *r;
+    return 0;
+}
+
+static int try_offset (struct SCAN *scan, enum DK_FORMAT format, size_t offset) {
+    struct DK_SCAN_RESULT r;
+    struct COMPRESSOR dc;
+    size_t limit, used;
+    int e;
+
+    memset(&dc, 0, sizeof(struct COMPRESSOR));
+    dc.in.data   = scan->input + offset;
+    dc.in.length = scan->input_size - offset;
+
+    if (!plausible(scan, format, &dc, &limit, &r.score))
+        return 0;
+
+    /* a bounded trial decode */
+    dc.out.data  = scan->buffer;
+    dc.out.limit = limit;
+    e = comp_table[format].decomp(&dc);
+
+    /* (some decoders write a little past their position) */
+    used = dc.out.pos + 4;
+    memset(scan->buffer, 0, (used < limit) ? used : limit);
+    if (e)
+        return 0;
+
+    r.offset            = offset;
+    r.format            = format;
+    r.decompressed_size = dc.out.pos;
+    adjust_compressed_size(format, &dc, &r.compressed_size);
+
+    /* compressed data that doesn't get any bigger is probably a fluke */
+    if (r.decompressed_size < scan->min_output
+    ||  r.decompressed_size < r.compressed_size)
+        return 0;
+    return add_result(scan, &r);
+}
+
+int dk_scan (
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_SCAN_OPTIONS *options,
+    struct DK_SCAN_RESULT **results,
+    size_t *result_count
+) {
+    static const struct DK_SCAN_OPTIONS defaults;
+    enum DK_FORMAT formats[COMP_LIMIT];
+    size_t format_count = 0;
+    size_t offset, end, align, i;
+    struct SCAN scan;
+    int e = 0;
+
+    if (results == NULL || result_count == NULL)
+        return DK_ERROR_NULL_INPUT;
+    *results      = NULL;
+    *result_count = 0;
+    if (input == NULL)
+        return DK_ERROR_NULL_INPUT;
+    if (options == NULL)
+        options = &defaults;
+
+    /* which formats to look for */
+    if (options->formats == NULL) {
+        for (i = 0; i < COMP_LIMIT; i++)
+            if (scan_default[i])
+                formats[format_count++] = i;
+    }
+    else {
+        for (i = 0; i < options->format_count; i++) {
+            enum DK_FORMAT f = options->formats[i];
+            if ((int)f < 0 || f >= COMP_LIMIT || comp_table[f].decomp == NULL)
+                return DK_ERROR_DECOMP_NOT;
+            if (format_count < COMP_LIMIT)
+                formats[format_count++] = f;
+        }
+    }
+
+    memset(&scan, 0, sizeof(struct SCAN));
+    scan.input      = input;
+    scan.input_size = input_size;
+    scan.min_output = options->min_output ? options->min_output : SCAN_MIN_OUTPUT;
+    scan.max_output = options->max_output ? options->max_output : SCAN_MAX_OUTPUT;
+    if ((scan.buffer = calloc(scan.max_output, 1)) == NULL)
+        return DK_ERROR_ALLOC;
+
+    end   = (options->end && options->end < input_size) ? options->end : input_size;
+    align = options->align ? options->align : 1;
+
+    /* offsets are aligned to the start of the input, not the region */
+    offset = (options->start + align - 1) / align * align;
+    for (; offset < end && !e; offset += align)
+        for (i = 0; i < format_count && !e; i++)
+            e = try_offset(&scan, formats[i], offset);
+
+    free(scan.buffer);
+    if (e) {
+        free(scan.results);
+        return e;
+    }
+    *results      = scan.results;
+    *result_count = scan.count;
+    return 0;
+}
@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - streaming decompression */
+
+#include <stdlib.h>
+
+#include "dkcomp.h"
+#include "dk_internal.h"
+
+static int (* const stream_table[COMP_LIMIT])(struct DK_STREAM*) = {
+    [  GBA_LZ77_COMP] = gbalz77_stream,
+    [GBA_HUFF20_COMP] = gbahuff20_stream,
+    [   GBA_RLE_COMP] = gbarle_stream,
+    [GBA_HUFF50_COMP] = gbahuff50_stream,
+    [GBA_HUFF60_COMP] = gbahuff60_stream,
+    [       GBA_COMP] = gba_stream
+};
+
+int dk_stream_init (
+    struct DK_STREAM **stream,
+    enum DK_FORMAT type,
+    unsigned char *input,
+    size_t input_size
+) {
+    int (*init)(struct DK_STREAM*);
+    struct DK_STREAM *s;
+    int e;
+
+    if (stream == NULL || input == NULL)
+        return DK_ERROR_NULL_INPUT;
+    *stream = NULL;
+
+    if ((int)type < 0 || type >= COMP_LIMIT
+    || (init = stream_table[type]) == NULL)
+        return DK_ERROR_DECOMP_NOT;
+
+    s = calloc(1, sizeof(struct DK_STREAM));
+    if (s == NULL)
+        return DK_ERROR_ALLOC;
+    s->dc.in.data   = input;
+    s->dc.in.length = input_size;
+
+    if ((e = init(s))) {
+        dk_stream_free(s);
+        return e;
+    }
+    *stream = s;
+    return 0;
+}
+
+int dk_stream_read (
+    struct DK_STREAM *s,
+    unsigned char *output,
+    size_t output_size,
+    size_t *written
+) {
+    if (written != NULL)
+        *written = 0;
+    if (s == NULL || output == NULL || written == NULL)
+        return DK_ERROR_NULL_INPUT;
+    if (s->error)
+        return s->error;
+
+    s->dc.out.data  = output;
+    s->dc.out.limit = output_size;
+    s->dc.out.pos   = 0;
+
+    s->error = s->read(s);
+    s->done += s->dc.out.pos;
+    *written = s->dc.out.pos;
+    return s->error;
+}
+
+size_t dk_stream_size (struct DK_STREAM *s) {
+    return (s != NULL) ? s->size : 0;
+}
+
+void dk_stream_free (struct DK_STREAM *s) {
+    if (s == NULL)
+        return;
+    free(s->state);
+    free(s);
+}
+
+
+
+/* Random access */
+
+#define INDEX_INTERVAL 0x4000
+
+int dk_index_create (
+    enum DK_FORMAT type,
+    unsigned char *input,
+    size_t input_size,
+    size_t interval,
+    unsigned char **index,
+    size_t *index_size
+) {
+    struct DK_STREAM *s;
+    int e;
+
+    if (index == NULL || index_size == NULL)
+        return DK_ERROR_NULL_INPUT;
+    *index      = NULL;
+    *index_size = 0;
+    if (type != GBA_LZ77_COMP)
+        return DK_ERROR_DECOMP_NOT;
+
+    /* (sizes are 24-bit anyway) */
+    if (!interval)
+        interval = INDEX_INTERVAL;
+    else if (interval > 1 << 24)
+        interval = 1 << 24;
+
+    if ((e = dk_stream_init(&s, type, input, input_size)))
+        return e;
+    e = gbalz77_index(s, interval, index, index_size);
+    dk_stream_free(s);
+    return e;
+}
+
+int dk_index_read (
+    enum DK_FORMAT type,
+    unsigned char *input,
+    size_t input_size,
+    const unsigned char *index,
+    size_t index_size,
+    size_t offset,
+    unsigned char *output,
+    size_t output_size
+) {
+    struct DK_STREAM *s;
+    int e;
+
+    if (index == NULL || (output == NULL && output_size))
+        return DK_ERROR_NULL_INPUT;
+    if (type != GBA_LZ77_COMP)
+        return DK_ERROR_DECOMP_NOT;
+
+    if ((e = dk_stream_init(&s, type, input, input_size)))
+        return e;
+    e = gbalz77_index_read(s, index, index_size, offset, output, output_size);
+    dk_stream_free(s);
+    return e;
+}
@@ -44,12 +44,24 @@ static int write_byte (struct COMPRESSOR *dk, unsigned char val) {
     return 0;
 }
 
+/* the first command can't end straight away, or copy from output */
+int dkcchr_probe (struct COMPRESSOR *dk) {
+    int n;
+    if (dk->in.length < 0x81)
+        return 0;
+    n = dk->in.data[0x80];
+    if (!n || ((n >> 6) == 2 && (n & 0x3F)))
+        return 0;
+    return 10;
+}
+
 int dkcchr_decompress (struct COMPRESSOR *dk) {
 
     int n;
     dk->in.pos = 0x80; /* LUT at 0x00, data at 0x80 */
 
     while ((n = read_byte(dk)) > 0) {
+        size_t start = dk->out.pos;
         int v;
         unsigned char mode;
 
@@ -78,6 +90,8 @@ int dkcchr_decompress (struct COMPRESSOR *dk) {
                 int pos;
                 if ((pos = read_word(dk)) < 0)
                     return DK_ERROR_OOB_INPUT;
+                if ((size_t)pos + n > dk->out.pos)
+                    stats_slow(dk);
                 while (n--) {
                     if ((v = read_out(dk, pos++)) < 0)
                         return DK_ERROR_OOB_OUTPUT_R;
@@ -95,6 +109,7 @@ int dkcchr_decompress (struct COMPRESSOR *dk) {
                 break;
             }
         }
+        stats_case(dk, mode, dk->out.pos - start);
     }
     return 0;
 }
@@ -109,14 +124,8 @@ int dkcchr_decompress (struct COMPRESSOR *dk) {
 
 /* compressor */
 
-struct PATH {
-    struct PATH *link;
-    size_t used;
-    struct NCASE {
-        unsigned short addr; /* mode 2 */
-        unsigned char mode:2, count:6;
-    } nc;
-};
+/* each case is stored as its control byte, with the address above that */
+#define NCASE(addr, mode, count) ((uint32_t)(addr) << 8 | (mode) << 6 | (count))
 
 /* LUT counters */
 struct U16 {
@@ -127,33 +136,11 @@ struct U16 {
 /* container */
 struct BIN {
     struct COMPRESSOR *dk;
-    struct PATH *steps;
+    struct DK_PATH path;
     struct U16 *lutc;
     unsigned short lut[64];
 };
 
-static void reset_steps (struct BIN *bin) {
-    size_t i;
-    for (i = 0; i <= bin->dk->in.length; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, {0,0,0} };
-        bin->steps[i] = p;
-    }
-    bin->steps[0].used = 0;
-}
-
-static void reverse_path (struct BIN *bin) {
-    struct PATH *prev = &bin->steps[bin->dk->in.length];
-    struct PATH *step = prev->link;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
-    }
-}
-
-
-
 static int sort_us (const void *aa, const void *bb) {
     const unsigned short *a = aa, *b = bb;
     return (*a > *b) ? -1 : (*a < *b);
@@ -202,19 +189,18 @@ static void lut_count (
     }
 
     if (copy_mode) { /* only search copy cases */
-        struct PATH *step = &bin->steps[bin->dk->in.length];
-        while (step->link != NULL) {
-            struct PATH *prev = step->link;
-            if (!prev->nc.mode) {
-                size_t start = prev - bin->steps;
-                size_t end   = step - bin->steps;
+        struct DK_PATH *path = &bin->path;
+        size_t end = path->length;
+        while (path->len[end]) {
+            size_t start = end - path->len[end];
+            if (!((path->ncase[start] >> 6) & 3)) {
                 switch (count_mode) {
                     case 0: { u16_count(bin, start,   end-1, 0); break; }
                     case 1: { u16_count(bin, start,   end-2, 1); break; }
                     case 2: { u16_count(bin, start+1, end-2, 1); break; }
                 }
             }
-            step = prev;
+            end = start;
         }
     }
     else { /* search everywhere */
@@ -245,27 +231,19 @@ static void lut_count (
 static void test_case_0 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
     size_t j;
-    struct PATH *step = &bin->steps[i];
     size_t limit = (64 < dk->in.length+1 - i)
                  ?  64 : dk->in.length+1 - i;
 
     /* test all subsequent nodes */
-    for (j = 1; j < limit; j++) {
-        struct PATH *next = &bin->steps[i+j];
-        size_t used = step->used + 1 + j;
-        if (next->used > used) {
-            struct PATH p = { step, used, { 0, 0, j } };
-            *next = p;
-        }
-    }
+    for (j = 1; j < limit; j++)
+        path_test(&bin->path, i, j, bin->path.cost[i] + 1 + j, NCASE(0, 0, j));
 }
 
 /* case 1: RLE */
 static void test_case_1 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
     size_t j = 1;
-    struct PATH *step = &bin->steps[i];
-    size_t used = step->used + 2;
+    uint32_t used = bin->path.cost[i] + 2;
     size_t limit = (64 < dk->in.length - i)
                  ?  64 : dk->in.length - i;
 
@@ -275,22 +253,16 @@ static void test_case_1 (struct BIN *bin, size_t i) {
             break;
 
     /* test all subsequent nodes */
-    while (j--) {
-        struct PATH *next = &bin->steps[i+j];
-        if (next->used > used) {
-            struct PATH p = { step, used, { 0, 1, j } };
-            *next = p;
-        }
-    }
+    while (j--)
+        path_test(&bin->path, i, j, used, NCASE(0, 1, j));
 }
 
 /* case 2: copy output */
 static void test_case_2 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
     size_t j = 0;
-    struct PATH *step = &bin->steps[i];
-    struct NCASE max = { 0,0,0 };
-    size_t used = step->used + 3;
+    struct { unsigned short addr; unsigned char count:6; } max = { 0,0 };
+    uint32_t used = bin->path.cost[i] + 3;
     size_t limit = (64 < dk->in.length - i)
                  ?  64 : dk->in.length - i;
 
@@ -303,6 +275,7 @@ static void test_case_2 (struct BIN *bin, size_t i) {
     /* find the longest match */
     for (; j < i; j++) {
         size_t match;
+        stats_probe(dk);
         for (match = 0; match < limit; match++)
             if (dk->in.data[i+match] != dk->in.data[j+match])
                 break;
@@ -315,39 +288,41 @@ static void test_case_2 (struct BIN *bin, size_t i) {
     }
 
     /* test all subsequent nodes */
-    for (j = 2; j <= max.count; j++) {
-        struct PATH *next = &bin->steps[i+j];
-        if (next->used > used) {
-            struct PATH p = { step, used, { max.addr, 2, j } };
-            *next = p;
-        }
-    }
+    for (j = 2; j <= max.count; j++)
+        path_test(&bin->path, i, j, used, NCASE(max.addr, 2, j));
 }
 
 /* case 3: LUT containing 64x16-bit words */
 static void test_case_3 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *dk = bin->dk;
-    struct PATH *step = &bin->steps[i];
-    struct PATH *next = &bin->steps[i+2];
     unsigned short *match;
     unsigned short word = (dk->in.data[i+1] << 8) | dk->in.data[i];
-    size_t used = step->used + 1;
 
     /* search for the current word in the LUT */
     match = bsearch(&word, bin->lut, 64, sizeof(unsigned short), sort_us);
     if (match == NULL)
         return;
 
-    if (next->used > used) {
-        struct PATH p = { step, used, { 0, 3, match - bin->lut } };
-        *next = p;
-    }
+    path_test(&bin->path, i, 2, bin->path.cost[i] + 1, NCASE(0, 3, match - bin->lut));
+}
+
+/* every path to the end passes through one of the next 64 nodes, */
+/* so the cheapest of those is a lower bound for the final size */
+static int over_budget (struct BIN *bin, size_t i) {
+    uint32_t least = path_least(&bin->path, i, 64);
+    return least != PATH_UNSEEN
+        && OVER_BUDGET(bin->dk, 128 + least);
 }
 
-static void test_cases (struct BIN *bin, int use_lut) {
+static int test_cases (struct BIN *bin, int use_lut) {
+    struct COMPRESSOR *dk = bin->dk;
     size_t i;
-    reset_steps(bin);
+    path_clear(&bin->path);
     for (i = 0; i < bin->dk->in.length-1; i++) {
+        if (dk->opt.budget && !(i & 255) && over_budget(bin, i))
+            return DK_ERROR_BUDGET;
+        if (dk_poll(dk, i, dk->in.length))
+            return DK_ERROR_CANCELLED;
         test_case_0(bin, i); /* copy */
         test_case_1(bin, i); /* RLE */
         test_case_2(bin, i); /* window */
@@ -355,58 +330,71 @@ static void test_cases (struct BIN *bin, int use_lut) {
             test_case_3(bin, i); /* LUT */
     }
     test_case_0(bin, i);
+    return 0;
 }
 
-static void run_case (struct BIN *bin, int n) {
+/* choosing the LUT counts as setup, and the last pass as the search */
+static int run_case (struct BIN *bin, int n) {
+    double t = stats_start(bin->dk);
+    enum DK_ERROR e = 0;
     memset(bin->lut, 0, 64*sizeof(unsigned short));
-    reset_steps(bin);
+    path_clear(&bin->path);
 
 #define CASE_COUNT 13
     switch (n) {
         case 0: { /* no LUT */
-            test_cases(bin, 0);
+            e = test_cases(bin, 0);
             break;
         }
         case 1:   /* interleaved counting */
         case 2:   /* odd counting */
         case 3: { /* even counting */
             lut_count (bin, n-1, 0, 0);
-            test_cases(bin, 1);
+            stats_phase(bin->dk, DK_PHASE_SETUP, &t);
+            e = test_cases(bin, 1);
             break;
         }
         case 4: /* same, but only counting copy cases */
         case 5:
         case 6: {
-            test_cases (bin, 0);
+            if ((e = test_cases(bin, 0)))
+                break;
             lut_count  (bin, n-4, 1, 0);
-            reset_steps(bin);
-            test_cases (bin, 1);
+            path_clear (&bin->path);
+            stats_phase(bin->dk, DK_PHASE_SETUP, &t);
+            e = test_cases(bin, 1);
             break;
         }
         case 7:
         case 8:
         case 9: {
             lut_count (bin, n-7, 0, 1);
-            test_cases(bin, 1);
+            stats_phase(bin->dk, DK_PHASE_SETUP, &t);
+            e = test_cases(bin, 1);
             break;
         }
         case 10:
         case 11:
         case 12: {
-            test_cases (bin, 0);
+            if ((e = test_cases(bin, 0)))
+                break;
             lut_count  (bin, n-10, 1, 1);
-            reset_steps(bin);
-            test_cases (bin, 1);
+            path_clear (&bin->path);
+            stats_phase(bin->dk, DK_PHASE_SETUP, &t);
+            e = test_cases(bin, 1);
             break;
         }
     }
+    stats_phase(bin->dk, DK_PHASE_SEARCH, &t);
+    return e;
 }
 
 
 /* traverse the path and write data */
 static int write_data (struct BIN *bin) {
     struct COMPRESSOR *dk = bin->dk;
-    struct PATH *step = bin->steps;
+    struct DK_PATH *path = &bin->path;
+    size_t pos;
     int i;
 
     /* write the LUT */
@@ -416,18 +404,20 @@ static int write_data (struct BIN *bin) {
             return DK_ERROR_OOB_OUTPUT_W;
 
     /* encode the input data */
-    while (step != &bin->steps[dk->in.length]) {
-        struct PATH *next = step->link;
-        struct NCASE *nc = &next->nc;
+    for (pos = 0; pos < dk->in.length; pos += path->len[pos]) {
+        uint32_t nc = path->ncase[pos + path->len[pos]];
+        int count = nc & 63;
+
+        stats_case(dk, (nc >> 6) & 3, path->len[pos]);
 
         /* control byte */
-        if (write_byte(dk, (nc->mode << 6) | nc->count))
+        if (write_byte(dk, nc & 255))
             return DK_ERROR_OOB_OUTPUT_W;
 
         /* data bytes */
-        switch (nc->mode) {
+        switch ((nc >> 6) & 3) {
             case 0: { /* copy */
-                for (i = 0; i < nc->count; i++)
+                for (i = 0; i < count; i++)
                     if (write_byte(dk, dk->in.data[dk->in.pos++]))
                         return DK_ERROR_OOB_OUTPUT_W;
                 break;
@@ -435,13 +425,13 @@ static int write_data (struct BIN *bin) {
             case 1: { /* RLE */
                 if (write_byte(dk, dk->in.data[dk->in.pos]))
                     return DK_ERROR_OOB_OUTPUT_W;
-                dk->in.pos += nc->count;
+                dk->in.pos += count;
                 break;
             }
             case 2: { /* history */
-                dk->in.pos += nc->count;
-                if (write_byte(dk, nc->addr)
-                ||  write_byte(dk, nc->addr >> 8))
+                dk->in.pos += count;
+                if (write_byte(dk, nc >>  8)
+                ||  write_byte(dk, nc >> 16))
                     return DK_ERROR_OOB_OUTPUT_W;
                 break;
             }
@@ -450,54 +440,65 @@ static int write_data (struct BIN *bin) {
                 break;
             }
         }
-        step = next;
     }
     return 0;
 }
 
 
 int dkcchr_compress (struct COMPRESSOR *dk) {
-    struct BIN bin = { dk, NULL, NULL, {0} };
-    size_t least_used_c = (size_t)-1;
-    int    least_used_n = 0;
+    struct BIN bin = { .dk = dk };
+    uint32_t least_used_c = PATH_UNSEEN;
+    int      least_used_n = 0;
     int i;
     enum DK_ERROR e;
     bin.dk = dk;
 
-    bin.steps = malloc(sizeof(struct PATH) * (dk->in.length+1));
-    bin.lutc  = malloc(65536*sizeof(struct U16));
-    if (bin.steps == NULL
-    ||  bin.lutc == NULL) {
-        free(bin.lutc);
-        free(bin.steps);
+    if ((e = path_init(&bin.path, dk->in.length)))
+        return e;
+    bin.lutc = malloc(65536*sizeof(struct U16));
+    if (bin.lutc == NULL) {
+        path_free(&bin.path);
         return DK_ERROR_ALLOC;
     }
 
     /* try a number of strategies */
     if (0) {
         for (i = 0; i < CASE_COUNT; i++) {
-            run_case(&bin, i);
-            if (least_used_c > bin.steps[dk->in.length].used) {
-                least_used_c = bin.steps[dk->in.length].used;
+            if ((e = run_case(&bin, i)) && e != DK_ERROR_BUDGET)
+                break;
+            if (!e && least_used_c > bin.path.cost[dk->in.length]) {
+                least_used_c = bin.path.cost[dk->in.length];
                 least_used_n = i;
             }
         }
         /* stick with the best case */
-        run_case(&bin, least_used_n);
+        e = run_case(&bin, least_used_n);
     }
     else {
         /* strategy #2 tends to work best for tilesets */
-        run_case(&bin, 2);
+        e = run_case(&bin, 2);
     }
 
-    /* reverse path direction */
-    reverse_path(&bin);
+    /* (128 byte LUT) */
+    if (!e && OVER_BUDGET(dk, 128 + bin.path.cost[dk->in.length]))
+        e = DK_ERROR_BUDGET;
 
-    /* write the output */
-    e = write_data(&bin);
+    if (!e && dk->dry_run)
+        dk->out.pos = 128 + bin.path.cost[dk->in.length];
+    else if (!e) {
+        double t = stats_start(dk);
 
-    free(bin.steps);
+        /* reverse path direction */
+        path_reverse(&bin.path);
+        stats_phase(dk, DK_PHASE_REVERSE, &t);
+
+        /* write the output */
+        e = write_data(&bin);
+        stats_phase(dk, DK_PHASE_EMIT, &t);
+        stats_path(dk, &bin.path);
+    }
+
+    path_free(&bin.path);
     free(bin.lutc);
     return e;
 }
-
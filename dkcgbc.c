@@ -25,12 +25,24 @@ static int write_byte (struct COMPRESSOR *gbc, unsigned char val) {
     return 0;
 }
 
+/* the first command can't end straight away, or copy from output */
+int dkcgbc_probe (struct COMPRESSOR *gbc) {
+    int n;
+    if (gbc->in.length < 2)
+        return 0;
+    n = gbc->in.data[0];
+    if (!n || ((n >> 6) == 3 && (n & 0x3F)))
+        return 0;
+    return 10;
+}
+
 int dkcgbc_decompress (struct COMPRESSOR *gbc) {
 
     int n;
     while ((n = read_byte(gbc)) > 0) {
-        int v;
-        switch (n >> 6) {
+        size_t start = gbc->out.pos;
+        int v, mode = n >> 6;
+        switch (mode) {
             default: { /* Single byte, 1-127 times */
                 if ((v = read_byte(gbc)) < 0)
                     return DK_ERROR_OOB_INPUT;
@@ -54,6 +66,8 @@ int dkcgbc_decompress (struct COMPRESSOR *gbc) {
                 if ((pos = read_byte(gbc)) < 0)
                     return DK_ERROR_OOB_INPUT;
                 n &= 0x3F;
+                if (pos < n)
+                    stats_slow(gbc);
                 while (n--) {
                     if ((v = read_out(gbc, pos)) < 0)
                         return DK_ERROR_OOB_OUTPUT_R;
@@ -63,6 +77,7 @@ int dkcgbc_decompress (struct COMPRESSOR *gbc) {
                 break;
             }
         }
+        stats_case(gbc, mode, gbc->out.pos - start);
     }
     return (n < 0) ? DK_ERROR_OOB_INPUT : 0;
 }
@@ -91,37 +106,19 @@ int dkcgbc_decompress (struct COMPRESSOR *gbc) {
 
 /* copy/pasted from DKC SNES with a few small changes */
 
-struct PATH {
-    struct PATH *link;
-    size_t used;
-    struct NCASE {
-        unsigned char addr;
-        unsigned char mode:2, count:6;
-    } nc;
-};
+/* each case is stored as its control byte, with the address above that */
+#define NCASE(addr, mode, count) ((uint32_t)(addr) << 8 | (mode) << 6 | (count))
 
 struct BIN {
     struct COMPRESSOR *gbc;
-    struct PATH *steps;
+    struct DK_PATH path;
 };
 
-static void reverse_path (struct BIN *bin) {
-    struct PATH *prev = &bin->steps[bin->gbc->in.length];
-    struct PATH *step = prev->link;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
-    }
-}
-
 /* case 0/1: RLE */
 static void test_case_1 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *gbc = bin->gbc;
     size_t j = 1;
-    struct PATH *step = &bin->steps[i];
-    size_t used = step->used + 2;
+    uint32_t used = bin->path.cost[i] + 2;
     size_t limit = (128 < gbc->in.length - i)
                  ?  128 : gbc->in.length - i;
 
@@ -132,41 +129,28 @@ static void test_case_1 (struct BIN *bin, size_t i) {
     }
 
     /* test all subsequent nodes */
-    while (j--) {
-        struct PATH *next = &bin->steps[i+j];
-        if (next->used > used) {
-            struct PATH p = { step, used, { 0, !!(j & 64), j & 63 } };
-            *next = p;
-        }
-    }
+    while (j--)
+        path_test(&bin->path, i, j, used, NCASE(0, !!(j & 64), j & 63));
 }
 
 /* case 2: copy input */
 static void test_case_2 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *gbc = bin->gbc;
     size_t j;
-    struct PATH *step = &bin->steps[i];
     size_t limit = (64 < gbc->in.length+1 - i)
                  ?  64 : gbc->in.length+1 - i;
 
     /* test all subsequent nodes */
-    for (j = 1; j < limit; j++) {
-        struct PATH *next = &bin->steps[i+j];
-        size_t used = step->used + 1 + j;
-        if (next->used > used) {
-            struct PATH p = { step, used, { 0, 2, j } };
-            *next = p;
-        }
-    }
+    for (j = 1; j < limit; j++)
+        path_test(&bin->path, i, j, bin->path.cost[i] + 1 + j, NCASE(0, 2, j));
 }
 
 /* case 3: copy output */
 static void test_case_3 (struct BIN *bin, size_t i) {
     struct COMPRESSOR *gbc = bin->gbc;
     size_t j = 0;
-    struct PATH *step = &bin->steps[i];
-    struct NCASE max = { 0,0,0 };
-    size_t used = step->used + 2;
+    struct { unsigned char addr, count:6; } max = { 0,0 };
+    uint32_t used = bin->path.cost[i] + 2;
     size_t limit = (64 < gbc->in.length - i)
                  ?  64 : gbc->in.length - i;
     if (i > (1 << 8))
@@ -175,6 +159,7 @@ static void test_case_3 (struct BIN *bin, size_t i) {
     /* find the longest match */
     for (; j < i; j++) {
         size_t match;
+        stats_probe(gbc);
         for (match = 0; match < limit; match++)
             if (gbc->in.data[i+match] != gbc->in.data[j+match])
                 break;
@@ -187,45 +172,53 @@ static void test_case_3 (struct BIN *bin, size_t i) {
     }
 
     /* test all subsequent nodes */
-    for (j = 2; j <= max.count; j++) {
-        struct PATH *next = &bin->steps[i+j];
-        if (next->used > used) {
-            struct PATH p = { step, used, { max.addr, 3, j } };
-            *next = p;
-        }
-    }
+    for (j = 2; j <= max.count; j++)
+        path_test(&bin->path, i, j, used, NCASE(max.addr, 3, j));
+}
+
+
+/* every path to the end passes through one of the next 128 nodes, */
+/* so the cheapest of those is a lower bound for the final size */
+static int over_budget (struct BIN *bin, size_t i) {
+    uint32_t least = path_least(&bin->path, i, 128);
+    return least != PATH_UNSEEN
+        && OVER_BUDGET(bin->gbc, least + 1);
 }
 
 
 /* traverse the path and write data */
 static int write_data (struct BIN *bin) {
     struct COMPRESSOR *gbc = bin->gbc;
-    struct PATH *step = bin->steps;
+    struct DK_PATH *path = &bin->path;
+    size_t pos;
     int i;
 
     /* encode the input data */
-    while (step != &bin->steps[gbc->in.length]) {
-        struct PATH *next = step->link;
-        struct NCASE *nc = &next->nc;
+    for (pos = 0; pos < gbc->in.length; pos += path->len[pos]) {
+        uint32_t nc = path->ncase[pos + path->len[pos]];
+        int mode  = (nc >> 6) & 3;
+        int count =  nc & 63;
         int v;
 
+        stats_case(gbc, mode, path->len[pos]);
+
         /* control byte */
-        if (write_byte(gbc, (nc->mode << 6) | nc->count))
+        if (write_byte(gbc, nc & 255))
             return DK_ERROR_OOB_OUTPUT_W;
 
         /* data bytes */
-        switch (nc->mode) {
+        switch (mode) {
             case 0:
             case 1: { /* RLE */
                 if ((v = read_byte(gbc)) < 0)
                     return DK_ERROR_OOB_INPUT;
                 if (write_byte(gbc, v))
                     return DK_ERROR_OOB_OUTPUT_W;
-                gbc->in.pos += 64*nc->mode + nc->count - 1;
+                gbc->in.pos += 64*mode + count - 1;
                 break;
             }
             case 2: { /* copy input */
-                for (i = 0; i < nc->count; i++) {
+                for (i = 0; i < count; i++) {
                     if ((v = read_byte(gbc)) < 0)
                         return DK_ERROR_OOB_INPUT;
                     if (write_byte(gbc, v))
@@ -234,13 +227,12 @@ static int write_data (struct BIN *bin) {
                 break;
             }
             case 3: { /* copy output */
-                gbc->in.pos += nc->count;
-                if (write_byte(gbc, nc->addr))
+                gbc->in.pos += count;
+                if (write_byte(gbc, nc >> 8))
                     return DK_ERROR_OOB_OUTPUT_W;
                 break;
             }
         }
-        step = next;
     }
 
     /* terminating byte */
@@ -253,43 +245,49 @@ static int write_data (struct BIN *bin) {
 
 int dkcgbc_compress (struct COMPRESSOR *gbc) {
 
-    struct PATH *steps = malloc(sizeof(struct PATH) * (gbc->in.length+1));
-    struct BIN bin = { gbc, steps };
+    struct BIN bin = { .gbc = gbc };
+    double t = stats_start(gbc);
     size_t i;
     enum DK_ERROR e;
 
-    if (steps == NULL)
-        return DK_ERROR_ALLOC;
-
-    /* happy defaults! */
-    for (i = 0; i <= gbc->in.length; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, {0,0,0} };
-        steps[i] = p;
-    }
-    steps[0].used = 0;
+    if ((e = path_init(&bin.path, gbc->in.length)))
+        return e;
 
     /* test cases */
     for (i = 0; i < gbc->in.length; i++) {
+        if (gbc->opt.budget && !(i & 255) && over_budget(&bin, i)) {
+            path_free(&bin.path);
+            return DK_ERROR_BUDGET;
+        }
+        if (dk_poll(gbc, i, gbc->in.length)) {
+            path_free(&bin.path);
+            return DK_ERROR_CANCELLED;
+        }
         test_case_1(&bin, i);
         test_case_2(&bin, i);
         test_case_3(&bin, i);
     }
 
-    reverse_path(&bin);
+    /* (terminating byte) */
+    if (OVER_BUDGET(gbc, bin.path.cost[gbc->in.length] + 1)) {
+        path_free(&bin.path);
+        return DK_ERROR_BUDGET;
+    }
+    stats_phase(gbc, DK_PHASE_SEARCH, &t);
 
-    struct PATH *step = steps;
-    while (step != &bin.steps[gbc->in.length]) {
-        struct PATH *next = step->link;
-        int count;
-            count = next->nc.count;
-            if (next->nc.mode == 1)
-                count += 64;
-        step = step->link;
+    if (gbc->dry_run) {
+        gbc->out.pos = bin.path.cost[gbc->in.length] + 1;
+        path_free(&bin.path);
+        return 0;
     }
 
+    path_reverse(&bin.path);
+    stats_phase(gbc, DK_PHASE_REVERSE, &t);
+
     e = write_data(&bin);
+    stats_phase(gbc, DK_PHASE_EMIT, &t);
+    stats_path(gbc, &bin.path);
 
-    free(steps);
+    path_free(&bin.path);
     return e;
 }
-
@@ -46,10 +46,127 @@ GB_PRINTER_COMP,
 };
 
 
+/* Error codes returned by the functions below */
+enum DK_ERROR {
+    DK_SUCCESS,
+
+    DK_ERROR_OOB_INPUT,
+    DK_ERROR_OOB_OUTPUT_R,
+    DK_ERROR_OOB_OUTPUT_W,
+
+    DK_ERROR_ALLOC,
+
+    DK_ERROR_NULL_INPUT,
+    DK_ERROR_FILE_INPUT,
+    DK_ERROR_FILE_OUTPUT,
+    DK_ERROR_SEEK_INPUT,
+    DK_ERROR_FREAD,
+    DK_ERROR_FWRITE,
+
+    DK_ERROR_OFFSET_BIG,
+    DK_ERROR_OFFSET_NEG,
+    DK_ERROR_OFFSET_DIFF,
+
+    DK_ERROR_INPUT_SMALL,
+    DK_ERROR_INPUT_LARGE,
+    DK_ERROR_OUTPUT_SMALL,
+
+    DK_ERROR_SIZE_WRONG,
+    DK_ERROR_EARLY_EOF,
+
+    DK_ERROR_BAD_FORMAT,
+    DK_ERROR_GBA_DETECT,
+    DK_ERROR_SIG_WRONG,
+
+    DK_ERROR_COMP_NOT,
+    DK_ERROR_DECOMP_NOT,
+
+    DK_ERROR_SD_BAD_EXIT,
+    DK_ERROR_LZ77_HIST,
+    DK_ERROR_HUFF_WRONG,
+    DK_ERROR_HUFF_LEAF,
+    DK_ERROR_HUFF_DIST,
+    DK_ERROR_HUFF_NO_LEAF,
+    DK_ERROR_HUFF_OUTSIZE,
+    DK_ERROR_HUFF_STACKS,
+    DK_ERROR_HUFF_NODES,
+    DK_ERROR_HUFF_NODELIM,
+    DK_ERROR_HUFF_LEAFVAL,
+
+    DK_ERROR_TABLE_RANGE,
+    DK_ERROR_TABLE_VALUE,
+    DK_ERROR_TABLE_ZERO,
+
+    DK_ERROR_VERIFY_DEC,
+    DK_ERROR_VERIFY_SIZE,
+    DK_ERROR_VERIFY_DATA,
+
+    DK_ERROR_BUDGET,
+    DK_ERROR_CANCELLED,
+    DK_ERROR_INDEX_WRONG,
+
+    DK_ERROR_INVALID,
+    DK_ERROR_LIMIT
+};
+
 /* Error reporting */
 SHARED const char *dk_get_error (int);
 
 
+/* Compression and decompression statistics */
+/* only collected by libraries built with DKCOMP_STATS, otherwise the   */
+/* struct is just zeroed. cases are numbered the way each format does: */
+/* the command nibble for Big Data and DKL, the mode for DKC CHR/GBC,  */
+/* 0/1 for plain/repeated runs in GBA RLE and GB Printer, 0/1 for      */
+/* literals/history in GBA LZ77, 0/1 for known/new values in GBA       */
+/* Huffman 60 and unique/same/inc/dec for Small Data. decompressors    */
+/* count commands (or symbols, for Huffman) the same way, with bytes   */
+/* being the output they produced, and report their time as EMIT.      */
+enum DK_PHASE {
+    DK_PHASE_SETUP,   /* choosing constants, building trees */
+    DK_PHASE_SEARCH,  /* finding matches and the cheapest path */
+    DK_PHASE_REVERSE, /* following that path back */
+    DK_PHASE_EMIT,    /* writing the output */
+    DK_PHASE_LIMIT
+};
+#define DK_STATS_CASES 16
+struct DK_STATS {
+    int collected; /* nonzero if the library filled this in */
+    struct {
+        size_t count; /* how many times it was written */
+        size_t bytes; /* how much input it covered */
+    } cases[DK_STATS_CASES];
+    size_t probes;      /* earlier positions compared by the match finders */
+    size_t relaxations; /* steps tried while looking for the cheapest path */
+    size_t slow;        /* decompressor commands that a single bounds check */
+                        /* and block copy can't handle: copies overlapping  */
+                        /* their own output, or runs cut short at the end  */
+    double seconds[DK_PHASE_LIMIT];
+};
+
+
+/* Optional parameters for compression */
+/* a zeroed struct (or a NULL pointer) gives the default behaviour */
+struct DK_OPTIONS {
+    size_t budget; /* give up with DK_ERROR_BUDGET if the output would */
+                   /* exceed this many bytes (0 = no limit) */
+    size_t window; /* GBA LZ77: parse the input this many bytes at a time  */
+                   /* so memory use follows this rather than the input size */
+                   /* smaller windows compress slightly worse (0 = whole input) */
+    int verify;    /* decompress the output and compare it with the input, */
+                   /* failing with DK_ERROR_VERIFY_* if they don't match  */
+
+    /* the compressors call this every poll_interval input positions */
+    /* (0 = 256) in their main loops. a nonzero return gives up with  */
+    /* DK_ERROR_CANCELLED, so it's also how a caller cancels the work */
+    int (*progress)(void *progress_data, size_t done, size_t total);
+    void *progress_data;
+    size_t poll_interval;
+
+    struct DK_STATS *stats; /* filled in for each call if not NULL */
+};
+
+
 /* Compression functions */
 SHARED int dk_compress_mem_to_mem (
     enum DK_FORMAT,
@@ -58,6 +175,14 @@ SHARED int dk_compress_mem_to_mem (
     unsigned char *input,
     size_t input_size
 );
+SHARED int dk_compress_mem_to_mem_opt (
+    enum DK_FORMAT,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options
+);
 SHARED int dk_compress_mem_to_file (
     enum DK_FORMAT,
     const char *file_out,
@@ -76,6 +201,60 @@ SHARED int dk_compress_file_to_mem (
     const char *file_in
 );
 
+/* the exact size the compressed data would be, without writing it. */
+/* most formats only run their parse, the Huffman formats and Small  */
+/* Data are compressed in full and the output thrown away. options   */
+/* may be NULL, a budget fails early with DK_ERROR_BUDGET as usual.  */
+SHARED int dk_compressed_size_estimate (
+    enum DK_FORMAT,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options,
+    size_t *compressed_size
+);
+
+/* for compressing the same buffer again after small edits, as an editor */
+/* would. *parse should start as NULL and is kept between calls, along   */
+/* with a copy of the input. Big Data and DKL only search again from just */
+/* before the first byte that changed (or from the start for Big Data, if */
+/* the edit changes its constants), the other formats compress in full.   */
+/* the output is always the same as dk_compress_mem_to_mem_opt gives.     */
+struct DK_PARSE;
+SHARED int dk_compress_incremental (
+    enum DK_FORMAT,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options,
+    struct DK_PARSE **parse
+);
+SHARED void dk_parse_free (struct DK_PARSE *parse);
+
+/* decompress data and compare it with what it was compressed from, */
+/* returns DK_ERROR_VERIFY_* if they don't match. Small Data may give */
+/* back an extra byte for odd inputs, since it stores whole words.    */
+SHARED int dk_verify (
+    enum DK_FORMAT,
+    unsigned char *compressed,
+    size_t compressed_size,
+    unsigned char *original,
+    size_t original_size
+);
+
+/* the largest input a compressor accepts, or 0 if it doesn't exist */
+SHARED size_t dk_compress_limit (enum DK_FORMAT);
+
+/* how likely the input is to start with data in the given format,    */
+/* judging only by its first few bytes and without decoding anything.  */
+/* score is 0 when it can't be, and up to 100 for a convincing header. */
+SHARED int dk_probe (
+    enum DK_FORMAT,
+    unsigned char *input,
+    size_t input_size,
+    int *score
+);
+
 
 /* Decompression functions */
 SHARED int dk_decompress_mem_to_mem (
@@ -105,6 +284,35 @@ SHARED int dk_decompress_file_to_file (
     size_t position
 );
 
+/* only the stats member of the options is used here */
+SHARED int dk_decompress_mem_to_mem_opt (
+    enum DK_FORMAT,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *options
+);
+
+/* these also report how many bytes of input the compressed data took up, */
+/* so there's no need to call a size function as well */
+SHARED int dk_decompress_mem_to_mem_sized (
+    enum DK_FORMAT,
+    unsigned char **output,
+    size_t *output_size,
+    unsigned char *input,
+    size_t input_size,
+    size_t *compressed_size
+);
+SHARED int dk_decompress_file_to_mem_sized (
+    enum DK_FORMAT,
+    unsigned char **output,
+    size_t *output_size,
+    const char *file_in,
+    size_t file_position,
+    size_t *compressed_size
+);
+
 
 /* size functions */
 /* these report the size of the compressed data */
@@ -123,6 +331,87 @@ SHARED int dk_compressed_size_file (
 
 
 
+/* Scanning */
+/* looks for compressed data at every offset from start up to end. each */
+/* format gets a cheap look at its header, and only offsets that pass   */
+/* are decoded, with the output kept within max_output. results are     */
+/* sorted by offset and must be freed by the caller. the input is only  */
+/* read, so regions of a large image can be scanned in parallel.        */
+struct DK_SCAN_OPTIONS {
+    const enum DK_FORMAT *formats; /* NULL for Big Data and the GBA   */
+    size_t format_count;           /* formats, which have headers     */
+    size_t start, end;  /* region to scan (end = 0 for the whole input) */
+    size_t align;       /* only try multiples of this (0 = 1) */
+    size_t min_output;  /* ignore anything smaller than this (0 = 16) */
+    size_t max_output;  /* or larger than this (0 = 256 KiB) */
+};
+struct DK_SCAN_RESULT {
+    size_t offset;
+    enum DK_FORMAT format;
+    size_t compressed_size;
+    size_t decompressed_size;
+    int score;          /* from dk_probe */
+};
+SHARED int dk_scan (
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_SCAN_OPTIONS *options,
+    struct DK_SCAN_RESULT **results,
+    size_t *result_count
+);
+
+
+
+/* Streaming decompression */
+/* only the GBA BIOS formats are supported (DK_ERROR_DECOMP_NOT otherwise) */
+/* output is produced in whatever sized pieces the caller asks for, and  */
+/* *written is 0 once everything has been read. input must remain valid  */
+/* until the stream is freed. */
+struct DK_STREAM;
+SHARED int dk_stream_init (
+    struct DK_STREAM **stream,
+    enum DK_FORMAT,
+    unsigned char *input,
+    size_t input_size
+);
+SHARED int dk_stream_read (
+    struct DK_STREAM *stream,
+    unsigned char *output,
+    size_t output_size,
+    size_t *written
+);
+SHARED size_t dk_stream_size (struct DK_STREAM *stream);
+SHARED void dk_stream_free (struct DK_STREAM *stream);
+
+
+/* Random access */
+/* only GBA BIOS LZ77 is supported (DK_ERROR_DECOMP_NOT otherwise).     */
+/* an index records the decoder's state and its 4 KiB of history every */
+/* interval bytes of output (0 = 16 KiB), so that any range can be     */
+/* decoded starting from the nearest one. it's kept apart from the     */
+/* compressed data, which is left as it is, and can be saved and used  */
+/* again with the same data. the index must be freed by the caller.    */
+SHARED int dk_index_create (
+    enum DK_FORMAT,
+    unsigned char *input,
+    size_t input_size,
+    size_t interval,
+    unsigned char **index,
+    size_t *index_size
+);
+/* decode output_size bytes starting at offset into the decompressed data */
+SHARED int dk_index_read (
+    enum DK_FORMAT,
+    unsigned char *input,
+    size_t input_size,
+    const unsigned char *index,
+    size_t index_size,
+    size_t offset,
+    unsigned char *output,
+    size_t output_size
+);
+
+
 
 /* DKL Huffman functions */
 SHARED int dkl_huffman_decode (
@@ -51,6 +51,16 @@ static int write_byte_z (struct COMPRESSOR *dk, unsigned char val) {
 #define   write_byte(X) if (      write_byte_z(dk, X))   return DK_ERROR_OOB_OUTPUT_W;
 #define write_nibble(X) if (    write_nibble_z(dk, X))   return DK_ERROR_OOB_OUTPUT_W;
 
+/* nearly anything decodes, but it can't start by copying */
+/* from output or with the quit command                   */
+int dkl_probe (struct COMPRESSOR *dk) {
+    if (dk->in.length < 2
+    || (dk->in.data[0] >> 4) == 12
+    ||  dk->in.data[0] == 0xEE)
+        return 0;
+    return 5;
+}
+
 int dkl_decompress (struct COMPRESSOR *dk) {
 
     int quit = 0;
@@ -58,15 +68,18 @@ int dkl_decompress (struct COMPRESSOR *dk) {
     dk->out.bitpos = 4;
 
     for (;;) {
-        int a,b,n;
+        size_t start = dk->out.pos;
+        int a,b,n,ncase;
         read_nibble(a);
-        switch (a) {
+        switch (ncase = a) {
             default: {
                 read_nibble(b);
                 if (a < 11 || b < 14) { /* write a byte */
                     write_byte((a << 4) | b);
+                    ncase = 9;
                 }
                 else if (b == 14) { /* write increments, 3 + 0..15 times */
+                    ncase = 10;
                     read_byte(a);
                     read_nibble(n);
                     n += 3;
@@ -74,6 +87,7 @@ int dkl_decompress (struct COMPRESSOR *dk) {
                         write_byte(a++);
                 }
                 else { /* n == 15, write a word, 2 + 0..15 times */
+                    ncase = 11;
                     read_byte(a);
                     read_byte(b);
                     read_nibble(n);
@@ -98,6 +112,8 @@ int dkl_decompress (struct COMPRESSOR *dk) {
                 n += 4;
                 if (n  > 255)
                     n -= 256; /* values greater than 251 will overflow */
+                if (b + 1 < n)
+                    stats_slow(dk);
                 while (n--) {
                     size_t addr = dk->out.pos - b - 1;
                     if (addr >= dk->out.pos)
@@ -147,6 +163,7 @@ int dkl_decompress (struct COMPRESSOR *dk) {
         }
         if (quit)
             break;
+        stats_case(dk, ncase, dk->out.pos - start);
     }
     return 0;
 }
@@ -163,63 +180,28 @@ int dkl_decompress (struct COMPRESSOR *dk) {
 
 /* compressor */
 
-struct PATH {
-    struct PATH *link;
-    size_t used;         /* smallest number of nibbles to get here */
-    unsigned char ncase; /* which case brought us here? */
-    unsigned arg;        /* some cases need extra data */
-};
+/* each case is stored with its argument above it */
+#define NCASE(ncase, arg) ((uint32_t)(arg) << 8 | (ncase))
+
 struct BIN {
     struct COMPRESSOR *dk;
-    struct PATH *steps;
+    struct DK_PATH path;
 };
 
-/* path shenanigans */
-static void clear_path (struct BIN *bin) {
-    size_t i;
-    for (i = 0; i <= bin->dk->in.length; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, 0, 0 };
-        bin->steps[i] = p;
-    }
-    bin->steps[0].used = 0;
-    bin->steps[0].link = bin->steps; /* non-NULL */
-}
-static int reverse_path (struct BIN *bin) {
-    struct PATH *prev = &bin->steps[bin->dk->in.length];
-    struct PATH *step = prev->link;
-    bin->steps[0].link = NULL;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
-    }
-
-    /* notify if a path from beginning to end can't be found */
-    if (prev != bin->steps)
-        return DK_ERROR_BAD_FORMAT;
-    return 0;
-}
-
 
 
 /* write a byte once */
 static void test_single (struct BIN *bin, size_t pos) { /* 0..11:13 */
-    struct PATH *step = &bin->steps[pos];
-    struct PATH p = { step, 2+step->used, 9, 0 };
     unsigned char c = bin->dk->in.data[pos];
-    if ((c & 0xC0) == 0xC0
-    &&  (c & 0x0F) >= 0x0E)
+    if (c >= 0xBE) /* (anything higher is read as a command) */
         return;
-    if (step[1].used > p.used)
-        step[1] = p;
+    path_test(&bin->path, pos, 1, 2+bin->path.cost[pos], NCASE(9, 0));
 }
 
 /* incrementing values */
 static void test_incs (struct BIN *bin, size_t pos) { /* 11:14 */
-    struct PATH   *step = &bin->steps[pos];
     unsigned char *data = &bin->dk->in.data[pos];
-    struct PATH p = { step, 5+step->used, 10, 0 };
+    uint32_t used = 5+bin->path.cost[pos];
     size_t i, limit = 17;
     if (limit > bin->dk->in.length - pos)
         limit = bin->dk->in.length - pos;
@@ -228,15 +210,13 @@ static void test_incs (struct BIN *bin, size_t pos) { /* 11:14 */
             break;
     limit = i+1;
     for (i = 3; i <= limit; i++)
-        if (step[i].used > p.used)
-            step[i] = p;
+        path_test(&bin->path, pos, i, used, NCASE(10, 0));
 }
 
 /* repeating word */
 static void test_words (struct BIN *bin, size_t pos) { /* 11:15 */
-    struct PATH   *step = &bin->steps[pos];
     unsigned char *data = &bin->dk->in.data[pos];
-    struct PATH p = { step, 7+step->used, 11, 0 };
+    uint32_t used = 7+bin->path.cost[pos];
     size_t i, limit  = 35;
     if (limit > bin->dk->in.length - pos)
         limit = bin->dk->in.length - pos;
@@ -246,15 +226,13 @@ static void test_words (struct BIN *bin, size_t pos) { /* 11:15 */
             break;
     limit = i;
     for (i = 4; i <= limit; i+=2)
-        if (step[i].used > p.used)
-            step[i] = p;
+        path_test(&bin->path, pos, i, used, NCASE(11, 0));
 }
 
 /* repeating byte */
 static void test_repeat (struct BIN *bin, size_t pos) { /* 15 */
-    struct PATH   *step = &bin->steps[pos];
     unsigned char *data = &bin->dk->in.data[pos];
-    struct PATH p = { step, 4+step->used, 15, 0 };
+    uint32_t used = 4+bin->path.cost[pos];
     size_t i, limit = 138;
     if (limit > bin->dk->in.length - pos)
         limit = bin->dk->in.length - pos;
@@ -263,19 +241,15 @@ static void test_repeat (struct BIN *bin, size_t pos) { /* 15 */
             break;
     limit = i;
     for (i =  3; i < 11 && i <= limit; i++)
-        if (step[i].used > p.used)
-            step[i] = p;
-    p.used++;
+        path_test(&bin->path, pos, i, used, NCASE(15, 0));
+    used++;
     for (i = 11; i <= limit; i++)
-        if (step[i].used > p.used)
-            step[i] = p;
+        path_test(&bin->path, pos, i, used, NCASE(15, 0));
 }
 
 /* we've seen this data before! */
 static void test_win (struct BIN *bin, size_t pos) { /* 12 */
-    struct PATH   *step = &bin->steps[pos];
     unsigned char *data = &bin->dk->in.data[pos];
-    struct PATH p = { step, 0, 12, 0 };
     size_t j, i = (pos > 2047) ? (pos - 2047) : 0;
     size_t limit = 255; /* can't copy more than (251+4 = 255) bytes */
     struct MATCH {
@@ -292,6 +266,7 @@ static void test_win (struct BIN *bin, size_t pos) { /* 12 */
     for (; i < pos; i++) { /* i = output position */
         size_t match;
         struct MATCH *mm = m;
+        stats_probe(bin->dk);
         for (match = 0; match < limit; match++)
             if (bin->dk->in.data[i+match] != data[match])
                 break;
@@ -307,22 +282,18 @@ static void test_win (struct BIN *bin, size_t pos) { /* 12 */
 
     for (i = 0; i < 4; i++) {
         for (j = 4; j <= m[i].size; j++) {
-            p.used = step->used
-                   + 4
-                   + ((pos - m[i].addr) > 127) /* +1 if distance > 127 */
-                   + ((j > 18) << 1);          /* +2 if match > 18 */
-            p.arg  = pos - m[i].addr - 1;
-            if (step[j].used > p.used)
-                step[j] = p;
+            uint32_t used = bin->path.cost[pos]
+                          + 4
+                          + ((pos - m[i].addr) > 127) /* +1 if distance > 127 */
+                          + ((j > 18) << 1);          /* +2 if match > 18 */
+            path_test(&bin->path, pos, j, used, NCASE(12, pos - m[i].addr - 1));
         }
     }
 }
 
 /* upper nibbles are all the same */
 static void test_nibble (struct BIN *bin, size_t pos) { /* 13, 14 */
-    struct PATH   *step = &bin->steps[pos];
     unsigned char *data = &bin->dk->in.data[pos];
-    struct PATH p = { step, 0, 13, 0 };
     size_t i, limit = 255+20;
 
     if (limit > bin->dk->in.length - pos)
@@ -332,27 +303,39 @@ static void test_nibble (struct BIN *bin, size_t pos) { /* 13, 14 */
         if ((data[0] & 0xF0) != (data[i] & 0xF0))
             break;
 
-    limit = i+1;
-    if (limit > bin->dk->in.length - pos)
-        limit = bin->dk->in.length - pos;
-    for (i = 4; i < limit; i++) {
+    limit = i;
+    for (i = 4; i <= limit; i++) {
         /* case 14 (the short variant) can't use 14 as the upper nibble */
         /* because 14:14 is the quit command */
-        if (i < 20 && (data[i] & 0xF0) == 0xE0)
+        if (i < 20 && (data[0] & 0xF0) == 0xE0)
             continue;
 
-        p.used  = step->used + 3 + i + !(i < 20);
-        p.ncase = 13 + (i < 20);
-        if (step[i].used > p.used)
-            step[i] = p;
+        path_test(&bin->path, pos, i,
+                  bin->path.cost[pos] + 3 + i + !(i < 20),
+                  NCASE(13 + (i < 20), 0));
     }
 }
 
-static void test_cases (struct BIN *bin) {
-    size_t i;
-    for (i = 0; i < bin->dk->in.length; i++) {
+/* no case reads or steps more than this far ahead (see path_resume) */
+#define REACH 275
+
+/* every path to the end passes through one of the next 275 nodes, */
+/* so the cheapest of those is a lower bound for the final size */
+static int over_budget (struct BIN *bin, size_t i) {
+    uint32_t least = path_least(&bin->path, i, REACH);
+    return least != PATH_UNSEEN
+        && OVER_BUDGET(bin->dk, (least + 3) / 2);
+}
+
+static int test_cases (struct BIN *bin, size_t i) {
+    struct COMPRESSOR *dk = bin->dk;
+    for (; i < bin->dk->in.length; i++) {
+        if (dk->opt.budget && !(i & 255) && over_budget(bin, i))
+            return DK_ERROR_BUDGET;
+        if (dk_poll(dk, i, dk->in.length))
+            return DK_ERROR_CANCELLED;
         /* skip the current position if it can't be reached */
-        if (bin->steps[i].link == NULL)
+        if (bin->path.cost[i] == PATH_UNSEEN)
             continue;
         test_single(bin, i);
         test_incs  (bin, i);
@@ -361,14 +344,19 @@ static void test_cases (struct BIN *bin) {
         test_win   (bin, i);
         test_nibble(bin, i);
     }
+    return 0;
 }
 
-static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
+static int encode_case (struct BIN *bin, size_t pos) {
     struct COMPRESSOR *dk = bin->dk;
+    size_t   len = bin->path.len[pos];
+    uint32_t  nc = bin->path.ncase[pos+len];
+
+    stats_case(dk, nc & 255, len);
 
-    switch (next->ncase) {
+    switch (nc & 255) {
         case 9: { /* single byte */
-            unsigned char c = dk->in.data[step - bin->steps];
+            unsigned char c = dk->in.data[pos];
             write_nibble(c >> 4); /* hi */
             write_nibble(c & 15); /* lo */
             break;
@@ -376,21 +364,21 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
         case 10: { /* incrementing data */
             write_nibble(11); /* cmd #1 */
             write_nibble(14); /* cmd #2 */
-            write_byte  (dk->in.data[step - bin->steps]); /* first */
-            write_nibble(next - step - 3); /* count */
+            write_byte  (dk->in.data[pos]); /* first */
+            write_nibble(len - 3); /* count */
             break;
         }
         case 11: { /* repeating word */
             write_nibble(11); /* cmd #1 */
             write_nibble(15); /* cmd #2 */
-            write_byte  (dk->in.data[  step-bin->steps]); /* lo */
-            write_byte  (dk->in.data[1+step-bin->steps]); /* hi */
-            write_nibble((next - step)/2 - 2); /* count */
+            write_byte  (dk->in.data[  pos]); /* lo */
+            write_byte  (dk->in.data[1+pos]); /* hi */
+            write_nibble((len)/2 - 2); /* count */
             break;
         }
         case 12: { /* history window */
-            size_t dist  = next->arg;
-            size_t match = next - step;
+            size_t dist  = nc >> 8;
+            size_t match = len;
             write_nibble(12); /* cmd */
             write_byte  ((dist << 1)|(dist > 127));  /* 0...6 */
             if (dist > 127)
@@ -404,27 +392,27 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
             break;
         }
         case 13: { /* lower nibbles (long) */
-            size_t count = next - step;
+            size_t count = len;
             write_nibble(13);
-            write_nibble(dk->in.data[step-bin->steps] >> 4);
+            write_nibble(dk->in.data[pos] >> 4);
             write_byte  (count - 20);
             while (count--)
-                write_nibble(dk->in.data[next-count-bin->steps-1]);
+                write_nibble(dk->in.data[pos+len-count-1]);
             break;
         }
         case 14: { /* lower nibbles (short) */
-            size_t count = next - step;
+            size_t count = len;
             write_nibble(14);
-            write_nibble(dk->in.data[step-bin->steps] >> 4);
+            write_nibble(dk->in.data[pos] >> 4);
             write_nibble(count - 4);
             while (count--)
-                write_nibble(dk->in.data[next-count-bin->steps-1]);
+                write_nibble(dk->in.data[pos+len-count-1]);
             break;
         }
         case 15: { /* repeating byte */
-            size_t count = next - step;
+            size_t count = len;
             write_nibble(15);
-            write_byte  (dk->in.data[step - bin->steps]);
+            write_byte  (dk->in.data[pos]);
             if (count > 10) {
                 count -= 8;
                 write_nibble(((count - 3) >> 4) | 8);
@@ -439,13 +427,11 @@ static int encode_case (struct BIN *bin, struct PATH *step, struct PATH *next) {
 
 static int write_output (struct BIN *bin) {
     struct COMPRESSOR *dk = bin->dk;
-    struct PATH *step = bin->steps;
+    size_t pos;
     enum DK_ERROR e;
-    while (step != &bin->steps[bin->dk->in.length]) {
-        if ((e = encode_case(bin, step, step->link)))
+    for (pos = 0; pos < dk->in.length; pos += bin->path.len[pos])
+        if ((e = encode_case(bin, pos)))
             return e;
-        step = step->link;
-    }
     /* quit command */
     write_nibble(14);
     write_nibble(14);
@@ -455,23 +441,35 @@ static int write_output (struct BIN *bin) {
 }
 
 int dkl_compress (struct COMPRESSOR *dk) {
-    struct PATH *steps = malloc((dk->in.length+1) * sizeof(struct PATH));
-    struct BIN bin = { dk, steps };
+    struct BIN bin = { .dk = dk };
+    double t = stats_start(dk);
+    size_t from = 0;
     enum DK_ERROR e;
     dk->out.bitpos = 4;
 
-    if (steps == NULL)
-        return DK_ERROR_ALLOC;
-
-    clear_path(&bin);
-    test_cases(&bin);
-
-    if ((e = reverse_path(&bin))
-    ||  (e = write_output(&bin))) {
-        free(steps);
+    if ((e = path_init(&bin.path, dk->in.length)))
         return e;
+
+    /* only redo the part of the parse after an edit */
+    if (dk->parse != NULL)
+        from = path_resume(&bin.path, &dk->parse->path[0], dk->parse->edit, REACH);
+
+    if (!(e = test_cases(&bin, from))
+    &&  (dk->parse == NULL || !(e = path_save(&bin.path, &dk->parse->path[0])))) {
+        stats_phase(dk, DK_PHASE_SEARCH, &t);
+        if (path_reverse(&bin.path))
+            e = DK_ERROR_BAD_FORMAT;
+        else if (OVER_BUDGET(dk, (bin.path.cost[dk->in.length] + 3) / 2))
+            e = DK_ERROR_BUDGET; /* (2 nibble quit command) */
+        stats_phase(dk, DK_PHASE_REVERSE, &t);
     }
-    free(steps);
-    return 0;
+    if (!e && dk->dry_run)
+        dk->out.pos = (bin.path.cost[dk->in.length] + 3) / 2;
+    else if (!e) {
+        e = write_output(&bin);
+        stats_phase(dk, DK_PHASE_EMIT, &t);
+        stats_path(dk, &bin.path);
+    }
+    path_free(&bin.path);
+    return e;
 }
-
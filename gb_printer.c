@@ -22,18 +22,31 @@ static int write_byte (struct COMPRESSOR *gb, unsigned char v) {
     return 0;
 }
 
+/* the first command has to fit in the input */
+int gbprinter_probe (struct COMPRESSOR *gb) {
+    int a;
+    if (gb->in.length < 2)
+        return 0;
+    a = gb->in.data[0];
+    if (!(a & 0x80) && gb->in.length < (size_t)a + 2)
+        return 0;
+    return 5;
+}
+
 int gbprinter_decompress (struct COMPRESSOR *gb) {
     while (gb->in.pos < gb->in.length && gb->out.pos < 0x280) {
         int a, count;
         RB(a);
+        count = (a & ~0x80) + ((a & 0x80) ? 2 : 1);
+        if (count > 0x280 - (int)gb->out.pos)
+            stats_slow(gb);
+        stats_case(gb, a >> 7, count);
         if (a & 0x80) { /* repeat */
-            count = (a & ~0x80) + 2;
             RB(a);
             while (count--)
                 WB(a);
         }
         else { /* copy */
-            count = (a & ~0x80) + 1;
             while (count--) {
                 RB(a);
                 WB(a);
@@ -44,50 +57,30 @@ int gbprinter_decompress (struct COMPRESSOR *gb) {
 }
 
 
-struct PATH {
-    struct PATH *link;
-    size_t used;
-    int ncase;
-};
-
-static void test_case (struct PATH *steps, size_t i, size_t j, size_t used, int ncase) {
-    struct PATH *a = &steps[i], *b = &steps[j];
-    if (b->used  > a->used + used) {
-        b->used  = a->used + used;
-        b->link  = a;
-        b->ncase = ncase;
-    }
-}
-static void test_cases (struct COMPRESSOR *gb, struct PATH *steps) {
+static int test_cases (struct COMPRESSOR *gb, struct DK_PATH *path) {
     size_t i,j;
     for (i = 0; i < gb->in.length; i++) {
+        if (dk_poll(gb, i, gb->in.length))
+            return DK_ERROR_CANCELLED;
         for (j = i+1; j < i+0x81 && j <= gb->in.length; j++) { /* raw */
-            test_case(steps, i, j, 1+j-i, 0);
+            path_test(path, i, j-i, path->cost[i]+1+j-i, 0);
         }
         for (j = i+2; j < i+0x82 && j <= gb->in.length; j++) { /* RLE */
             if (gb->in.data[i] != gb->in.data[j-1])
                 break;
-            test_case(steps, i, j, 2, 1);
+            path_test(path, i, j-i, path->cost[i]+2, 1);
         }
     }
+    return 0;
 }
 
-static void reverse_path (struct COMPRESSOR *gb, struct PATH *steps) {
-    struct PATH *prev = &steps[gb->in.length];
-    struct PATH *step = prev->link;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
-    }
-}
-static int write_output (struct COMPRESSOR *gb, struct PATH *steps) {
-    struct PATH *step = steps;
-    while (step != &steps[gb->in.length]) {
-        int a, count = step->link - step;
-        gb->in.pos = step - steps;
-        if (step->link->ncase) { /* rle */
+static int write_output (struct COMPRESSOR *gb, struct DK_PATH *path) {
+    size_t i;
+    for (i = 0; i < gb->in.length; i += path->len[i]) {
+        int a, count = path->len[i];
+        gb->in.pos = i;
+        stats_case(gb, path->ncase[i+count], count);
+        if (path->ncase[i+count]) { /* rle */
             WB(0x80 | (count-2));
             RB(a); WB(a);
         }
@@ -95,32 +88,31 @@ static int write_output (struct COMPRESSOR *gb, struct PATH *steps) {
             WB(count-1);
             while (count--) { RB(a); WB(a); }
         }
-        step = step->link;
     }
     return 0;
 }
 
 int gbprinter_compress (struct COMPRESSOR *gb) {
-    struct PATH *steps;
-    size_t i;
+    struct DK_PATH path;
+    double t = stats_start(gb);
     int e;
 
     if (gb->in.length < 0x280) return DK_ERROR_INPUT_SMALL;
     if (gb->in.length > 0x280) return DK_ERROR_INPUT_LARGE;
 
-    steps = malloc((gb->in.length+1) * sizeof(struct PATH));
-    if (steps == NULL)
-        return DK_ERROR_ALLOC;
+    if ((e = path_init(&path, gb->in.length)))
+        return e;
 
-    for (i = 0; i <= gb->in.length; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, 0 };
-        steps[i] = p;
+    if (!(e = test_cases(gb, &path)) && gb->dry_run)
+        gb->out.pos = path.cost[gb->in.length];
+    else if (!e) {
+        stats_phase(gb, DK_PHASE_SEARCH, &t);
+        path_reverse(&path);
+        stats_phase(gb, DK_PHASE_REVERSE, &t);
+        e = write_output(gb, &path);
+        stats_phase(gb, DK_PHASE_EMIT, &t);
+        stats_path(gb, &path);
     }
-    steps[0].used = 0;
-    test_cases  (gb, steps);
-    reverse_path(gb, steps);
-    e = write_output(gb, steps);
-    free(steps);
+    path_free(&path);
     return e;
 }
-
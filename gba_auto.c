@@ -19,3 +19,47 @@ int gba_decompress (struct COMPRESSOR *gba) {
     return DK_ERROR_GBA_DETECT;
 }
 
+
+int gba_size (struct COMPRESSOR *gba, size_t *size) {
+    if (gba->in.length < 5)
+        return DK_ERROR_EARLY_EOF;
+
+    switch (*gba->in.data >> 4) {
+        case 1: { return   gbalz77_size(gba, size); }
+        case 2: { return gbahuff20_size(gba, size); }
+        case 3: { return    gbarle_size(gba, size); }
+        case 5: { return gbahuff50_size(gba, size); }
+        case 6: { return gbahuff60_size(gba, size); }
+    }
+    return DK_ERROR_GBA_DETECT;
+}
+
+
+int gba_probe (struct COMPRESSOR *gba) {
+    if (gba->in.length < 5)
+        return 0;
+
+    switch (*gba->in.data >> 4) {
+        case 1: { return   gbalz77_probe(gba); }
+        case 2: { return gbahuff20_probe(gba); }
+        case 3: { return    gbarle_probe(gba); }
+        case 5: { return gbahuff50_probe(gba); }
+        case 6: { return gbahuff60_probe(gba); }
+    }
+    return 0;
+}
+
+
+int gba_stream (struct DK_STREAM *s) {
+    if (s->dc.in.length < 5)
+        return DK_ERROR_EARLY_EOF;
+
+    switch (*s->dc.in.data >> 4) {
+        case 1: { return   gbalz77_stream(s); }
+        case 2: { return gbahuff20_stream(s); }
+        case 3: { return    gbarle_stream(s); }
+        case 5: { return gbahuff50_stream(s); }
+        case 6: { return gbahuff60_stream(s); }
+    }
+    return DK_ERROR_GBA_DETECT;
+}
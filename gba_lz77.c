@@ -3,6 +3,7 @@
  * dkcomp library - GBA BIOS LZ77 compressor and decompressor */
 
 #include <stdlib.h>
+#include <string.h>
 #include "dk_internal.h"
 
 static int read_byte (struct COMPRESSOR *gba) {
@@ -18,9 +19,9 @@ static int write_byte (struct COMPRESSOR *gba, unsigned char v) {
     return 0;
 }
 
-int gbalz77_decompress (struct COMPRESSOR *gba) {
-    size_t output_size;
-    struct FILE_STREAM *in = &gba->in, *out = &gba->out;
+/* check the header and read the decompressed size */
+int gbalz77_size (struct COMPRESSOR *gba, size_t *size) {
+    struct FILE_STREAM *in = &gba->in;
 
     if (in->length < 5)
         return DK_ERROR_INPUT_SMALL;
@@ -28,8 +29,29 @@ int gbalz77_decompress (struct COMPRESSOR *gba) {
     if ((in->data[0] & 0xF0) != 0x10)
         return DK_ERROR_SIG_WRONG;
 
-    output_size = (in->data[3] << 16) | in->data[1]
-                | (in->data[2] <<  8);
+    *size = (in->data[3] << 16) | in->data[1]
+          | (in->data[2] <<  8);
+    return 0;
+}
+
+/* the lower bits of the signature are ignored, but nothing sets them. */
+/* nothing has been written when the first block starts, so it has to */
+/* be a plain byte rather than a history copy.                        */
+int gbalz77_probe (struct COMPRESSOR *gba) {
+    size_t size;
+    if (gbalz77_size(gba, &size) || !size
+    ||  gba->in.data[0] != 0x10 || (gba->in.data[4] & 0x80))
+        return 0;
+    return 80;
+}
+
+int gbalz77_decompress (struct COMPRESSOR *gba) {
+    size_t output_size;
+    struct FILE_STREAM *in = &gba->in, *out = &gba->out;
+    enum DK_ERROR e;
+
+    if ((e = gbalz77_size(gba, &output_size)))
+        return e;
     in->pos += 4;
 
     while (out->pos < output_size) {
@@ -49,7 +71,12 @@ int gbalz77_decompress (struct COMPRESSOR *gba) {
                 outpos = ((v1 & 15) << 8) | v2;
                 if (!out->pos || outpos > out->pos-1)
                     return DK_ERROR_LZ77_HIST;
-                while (count--) {
+                if (outpos + 1u < count || count > output_size - out->pos)
+                    stats_slow(gba);
+                stats_case(gba, 1, (count < output_size - out->pos)
+                                  ? count : output_size - out->pos);
+                /* (a block may run past the end of the output) */
+                while (count-- && out->pos < output_size) {
                     if (write_byte(gba, out->data[out->pos-outpos-1]))
                         return DK_ERROR_OOB_OUTPUT_W;
                 }
@@ -57,6 +84,7 @@ int gbalz77_decompress (struct COMPRESSOR *gba) {
             else {
                 if (write_byte(gba, v1))
                     return DK_ERROR_OOB_OUTPUT_W;
+                stats_case(gba, 0, 1);
             }
             if (out->pos == output_size)
                 break;
@@ -67,143 +95,373 @@ int gbalz77_decompress (struct COMPRESSOR *gba) {
 
 
 
+/* streaming decompressor */
+/* only the last 4 KiB of output needs to be kept around for history */
 
-struct PATH {
-    struct PATH *link;
-    size_t used; /* bytes and traversals used to get to this point */
-    struct NCASE { unsigned short count:4, offset:12; } ncase;
+struct LZ77_STREAM {
+    unsigned char hist[1 << 12]; /* ring buffer, indexed by output position */
+    int blocks;                  /* current block byte */
+    int remain;                  /* how many of its blocks are left */
+    unsigned count;              /* history copy in progress */
+    unsigned outpos;
 };
 
-int gbalz77_compress (struct COMPRESSOR *gba) {
+static int lz77_stream_read (struct DK_STREAM *s) {
+    struct LZ77_STREAM *st = s->state;
+    struct COMPRESSOR  *gba = &s->dc;
+    struct FILE_STREAM *out = &gba->out;
+
+    while (out->pos < out->limit && (s->done + out->pos) < s->size) {
+        size_t pos = s->done + out->pos;
+        unsigned char v;
 
-    struct PATH *steps = malloc((gba->in.length+1) * sizeof(struct PATH));
-    struct PATH *step = NULL, *prev = NULL;
+        if (st->count) { /* continue a history copy */
+            v = st->hist[(pos - st->outpos - 1) & 0xFFF];
+            st->count--;
+        }
+        else {
+            int v1;
+            if (!st->remain) {
+                if ((st->blocks = read_byte(gba)) < 0)
+                    return DK_ERROR_OOB_INPUT;
+                st->remain = 8;
+            }
+            st->remain--;
+            if ((v1 = read_byte(gba)) < 0)
+                return DK_ERROR_OOB_INPUT;
+            if (st->blocks & (1 << st->remain)) {
+                int v2;
+                if ((v2 = read_byte(gba)) < 0)
+                    return DK_ERROR_OOB_INPUT;
+                st->count  =  (v1 >> 4) + 3;
+                st->outpos = ((v1 & 15) << 8) | v2;
+                if (!pos || st->outpos > pos-1)
+                    return DK_ERROR_LZ77_HIST;
+                continue;
+            }
+            v = v1;
+        }
+        st->hist[pos & 0xFFF] = v;
+        out->data[out->pos++] = v;
+    }
+    return 0;
+}
+
+int gbalz77_stream (struct DK_STREAM *s) {
+    enum DK_ERROR e;
+    if ((e = gbalz77_size(&s->dc, &s->size)))
+        return e;
+    s->dc.in.pos = 4;
+    s->state = calloc(1, sizeof(struct LZ77_STREAM));
+    if (s->state == NULL)
+        return DK_ERROR_ALLOC;
+    s->read = lz77_stream_read;
+    return 0;
+}
+
+
+
+/* random access */
+/* the index is a copy of the streaming state every interval bytes of */
+/* output, so a range can be decoded from the nearest one before it.  */
+/* everything is stored little-endian:                                */
+/*   "LZIX", interval, decompressed size, compressed size (4 bytes each) */
+/*   then for each multiple of interval below the decompressed size:  */
+/*   input position (4), outpos (2), blocks, remain, count, 3 unused, */
+/*   and the 4 KiB history buffer                                     */
+
+#define INDEX_HEADER 16
+#define INDEX_ENTRY  (12 + (1 << 12))
+
+static void put32 (unsigned char *d, size_t v) {
+    d[0] = v; d[1] = v >> 8; d[2] = v >> 16; d[3] = v >> 24;
+}
+static size_t get32 (const unsigned char *d) {
+    return d[0] | (d[1] << 8) | (d[2] << 16) | ((size_t)d[3] << 24);
+}
+
+/* read and throw away output until we get to pos */
+static int lz77_skip (struct DK_STREAM *s, size_t pos) {
+    unsigned char buf[1024];
+    while (s->done < pos) {
+        size_t n = pos - s->done, written;
+        enum DK_ERROR e;
+        if ((e = dk_stream_read(s, buf, (n < sizeof(buf)) ? n : sizeof(buf), &written)))
+            return e;
+        if (!written)
+            return DK_ERROR_EARLY_EOF;
+    }
+    return 0;
+}
+
+int gbalz77_index (
+    struct DK_STREAM *s,
+    size_t interval,
+    unsigned char **index,
+    size_t *index_size
+) {
+    struct LZ77_STREAM *st = s->state;
+    size_t count = s->size ? (s->size - 1) / interval : 0;
+    size_t size  = INDEX_HEADER + count * INDEX_ENTRY;
+    unsigned char *d;
     size_t i;
+    enum DK_ERROR e;
 
-    if (steps == NULL)
+    if ((d = malloc(size)) == NULL)
         return DK_ERROR_ALLOC;
 
+    for (i = 1; i <= count; i++) {
+        unsigned char *entry = d + INDEX_HEADER + (i-1) * INDEX_ENTRY;
+        if ((e = lz77_skip(s, i * interval))) {
+            free(d);
+            return e;
+        }
+        put32(entry, s->dc.in.pos);
+        entry[4]  = st->outpos;
+        entry[5]  = st->outpos >> 8;
+        entry[6]  = st->blocks;
+        entry[7]  = st->remain;
+        entry[8]  = st->count;
+        entry[9]  = entry[10] = entry[11] = 0;
+        memcpy(&entry[12], st->hist, sizeof(st->hist));
+    }
+
+    /* only index data that decodes all the way through */
+    if ((e = lz77_skip(s, s->size))) {
+        free(d);
+        return e;
+    }
+    memcpy(d, "LZIX", 4);
+    put32(&d[ 4], interval);
+    put32(&d[ 8], s->size);
+    put32(&d[12], s->dc.in.pos);
+    *index      = d;
+    *index_size = size;
+    return 0;
+}
+
+int gbalz77_index_read (
+    struct DK_STREAM *s,
+    const unsigned char *index,
+    size_t index_size,
+    size_t offset,
+    unsigned char *output,
+    size_t output_size
+) {
+    struct LZ77_STREAM *st = s->state;
+    size_t interval, count, i, written;
+    enum DK_ERROR e;
+
+    /* does the index belong to this data? */
+    if (index_size < INDEX_HEADER || memcmp(index, "LZIX", 4))
+        return DK_ERROR_INDEX_WRONG;
+    interval = get32(&index[4]);
+    count    = s->size ? (s->size - 1) / (interval ? interval : 1) : 0;
+    if (!interval
+    ||  get32(&index[ 8]) != s->size
+    ||  get32(&index[12]) >  s->dc.in.length
+    ||  index_size != INDEX_HEADER + count * INDEX_ENTRY)
+        return DK_ERROR_INDEX_WRONG;
+
+    if (offset > s->size || output_size > s->size - offset)
+        return DK_ERROR_OFFSET_BIG;
+
+    /* start from the nearest entry */
+    if ((i = offset / interval) > count)
+        i = count;
+    if (i) {
+        const unsigned char *entry = index + INDEX_HEADER + (i-1) * INDEX_ENTRY;
+        if (entry[7] > 8 || get32(entry) > s->dc.in.length)
+            return DK_ERROR_INDEX_WRONG;
+        s->dc.in.pos = get32(entry);
+        st->outpos   = entry[4] | (entry[5] << 8);
+        st->blocks   = entry[6];
+        st->remain   = entry[7];
+        st->count    = entry[8];
+        memcpy(st->hist, &entry[12], sizeof(st->hist));
+        s->done      = i * interval;
+    }
+
+    if ((e = lz77_skip(s, offset)))
+        return e;
+    while (output_size) {
+        if ((e = dk_stream_read(s, output, output_size, &written)))
+            return e;
+        if (!written)
+            return DK_ERROR_EARLY_EOF;
+        output      += written;
+        output_size -= written;
+    }
+    return 0;
+}
+
+
+
+
+/* each case is stored as the two bytes it's written as */
+#define NCASE(count, offset) ((count) << 12 | (offset))
+
+/* every path to the end passes through one of the next 18 nodes. */
+/* costs aren't exact byte counts, but no block costs more than 8  */
+/* units per byte it writes, which still gives us a lower bound.   */
+static int over_budget (struct COMPRESSOR *gba, struct DK_PATH *path, size_t i) {
+    uint32_t least = path_least(path, i, 18);
+    return least != PATH_UNSEEN
+        && OVER_BUDGET(gba, gba->out.pos + least / 8);
+}
+
+/* block bytes are filled in as the blocks they describe are written */
+struct FLAGS {
+    size_t pos;   /* where the current block byte is */
+    unsigned count; /* how many blocks have been written so far */
+};
+
+static int write_block (
+    struct COMPRESSOR *gba,
+    struct FLAGS *f,
+    struct DK_PATH *path,
+    size_t i,
+    size_t pos
+) {
+    unsigned len = path->len[i];
+    stats_case(gba, len > 1, len);
+
+    /* costs aren't byte counts, so a dry run counts them here */
+    if (gba->dry_run) {
+        gba->out.pos += !(f->count++ & 7) + 1 + (len > 1);
+        return 0;
+    }
+    if (!(f->count++ & 7)) {
+        f->pos = gba->out.pos;
+        if (write_byte(gba, 0))
+            return 1;
+    }
+    if (len == 1) /* default case */
+        return write_byte(gba, gba->in.data[pos]);
+
+    /* history case */
+    gba->out.data[f->pos] |= 0x80 >> ((f->count-1) & 7);
+    return write_byte(gba, path->ncase[i+len] >> 8)
+        || write_byte(gba, path->ncase[i+len]);
+}
+
+/* with opt.window set, only that many bytes of the path are kept at a */
+/* time, after looking up to this much further ahead (but no more than */
+/* the window itself) to settle where it ends */
+#define LOOKAHEAD 1024
+
+int gbalz77_compress (struct COMPRESSOR *gba) {
+
+    struct DK_PATH path;
+    struct FLAGS flags = { 0, 0 };
+    double t = stats_start(gba);
+    size_t span = gba->in.length;
+    size_t base = 0;
+    size_t i;
+    enum DK_ERROR e;
+
+    if (gba->opt.window) {
+        size_t ahead = gba->opt.window;
+        if (ahead < 18)        ahead = 18;
+        if (ahead > LOOKAHEAD) ahead = LOOKAHEAD;
+        if (gba->opt.window + ahead < span)
+            span = gba->opt.window + ahead;
+    }
+
+    if ((e = path_init(&path, span)))
+        return e;
+
     /* write header */
-    if (write_byte(gba, 0x10)
+    if (gba->dry_run)
+        gba->out.pos = 4;
+    else if (write_byte(gba, 0x10)
     ||  write_byte(gba, gba->in.length)
     ||  write_byte(gba, gba->in.length >>  8)
     ||  write_byte(gba, gba->in.length >> 16))
         goto write_error;
 
-    /* happy defaults */
-    for (i = 0; i < gba->in.length+1; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, { 0,0 } };
-        steps[i] = p;
-    }
-    steps[0].used = 0;
-
-    /* determine the best path */
-    for (i = 0; i < gba->in.length; i++) {
-        struct NCASE max = {0,0};
-        struct PATH *next;
-        size_t used;
-        size_t j = 0; /* we can look this far back in the window */
-
-        step = &steps[i];
-        used = step->used + 10;
-
-        /* window is 12-bits max, data is up to 24-bit */
-        if (i > (1 << 12))
-        j = i - (1 << 12);
-
-        /* find the longest matching block in history */
-        for (; j < i; j++) {
-            unsigned char *a = &gba->in.data[i];
-            unsigned char *b = &gba->in.data[j];
-            size_t cmplim = 18; /* don't compare past this point */
-            size_t matched, k;
-
-            if (cmplim > (gba->in.length - i))
-                cmplim = (gba->in.length - i);
-
-            /* how many bytes match up to n in these two buffers */
-            for (matched = 0; matched < cmplim; matched++)
-                if (*a++ != *b++)
-                    break;
-
-            /* test all possible history cases */
-            if (matched >= 3 && max.count <= (matched-3)) {
-                for (k = max.count; k <= matched-3; k++) {
-                    next = &steps[i+k+3];
-                    if (next->used > used) {
-                        struct PATH p = { step, used, { k, i-j-1 } };
-                        *next = p;
-                    }
+    while (base < gba->in.length) {
+        size_t end = base + span;
+        size_t n, cut;
+
+        if (end > gba->in.length)
+            end = gba->in.length;
+        n = end - base;
+
+        path.length = n;
+        path_clear(&path);
+
+        /* determine the best path */
+        for (i = base; i < end; i++) {
+            size_t max = 0;
+            size_t j = 0; /* we can look this far back in the window */
+            uint32_t used;
+
+            if (gba->opt.budget && !((i-base) & 255)
+            &&  over_budget(gba, &path, i-base)) {
+                path_free(&path);
+                return DK_ERROR_BUDGET;
+            }
+            if (dk_poll(gba, i, gba->in.length)) {
+                path_free(&path);
+                return DK_ERROR_CANCELLED;
+            }
+
+            used = path.cost[i-base] + 10;
+
+            /* window is 12-bits max, data is up to 24-bit */
+            if (i > (1 << 12))
+            j = i - (1 << 12);
+
+            /* find the longest matching block in history */
+            for (; j < i; j++) {
+                unsigned char *a = &gba->in.data[i];
+                unsigned char *b = &gba->in.data[j];
+                size_t cmplim = 18; /* don't compare past this point */
+                size_t matched, k;
+
+                stats_probe(gba);
+                if (cmplim > (end - i))
+                    cmplim = (end - i);
+
+                /* how many bytes match up to n in these two buffers */
+                for (matched = 0; matched < cmplim; matched++)
+                    if (*a++ != *b++)
+                        break;
+
+                /* test all possible history cases */
+                if (matched >= 3 && max <= (matched-3)) {
+                    for (k = max; k <= matched-3; k++)
+                        path_test(&path, i-base, k+3, used, NCASE(k, i-j-1));
+                    max = matched-3;
+                    if (max == 15)
+                        break;
                 }
-                max.count  = matched-3;
-                max.offset = j;
-                if (max.count == 15)
-                    break;
             }
-        }
 
-        /* test the default case */
-        next = &steps[i+1];
-        used = step->used + 9;
-        if (next->used > used) {
+            /* test the default case */
             /* don't interpret the owl operator as a valid count */
             /* avoid that by checking adjacent distance first */
-            struct PATH p = { step, used, { 0,0 } };
-            *next = p;
+            path_test(&path, i-base, 1, path.cost[i-base] + 9, 0);
         }
-    }
 
-    /* reverse path direction */
-    prev = &steps[gba->in.length];
-    step = prev->link;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
-    }
-    steps[gba->in.length].link = NULL;
-
-    /* traverse the path and write data */
-    step = steps;
-    while (step != &steps[gba->in.length]) {
-        struct PATH *node = step;
-        unsigned char block = 0;
-        int blockc;
-
-        /* calculate the block byte by checking the next n <= 8 nodes */
-        for (blockc = 0; blockc < 8; blockc++) {
-            struct PATH *next = node->link;
-            if (next == NULL)
-                break;
-            block <<= 1;
-            if ((next - node) > 1)
-                block |= 1;
-            node = next;
-        }
-        if (write_byte(gba, block << (8 - blockc)))
-            goto write_error;
-
-        /* write the blocks */
-        while (blockc--) {
-            struct PATH *next = step->link;
-            if ((next - step) == 1) { /* default case */
-                if (write_byte(gba, gba->in.data[step-steps]))
-                    goto write_error;
-            }
-            else { /* history case */
-                struct NCASE *nc = &next->ncase;
-                if (write_byte(gba, (nc->offset >> 8) | (nc->count << 4))
-                ||  write_byte(gba,  nc->offset))
-                    goto write_error;
-            }
-            step = next;
-        }
+        stats_phase(gba, DK_PHASE_SEARCH, &t);
+        path_reverse(&path);
+        stats_phase(gba, DK_PHASE_REVERSE, &t);
+
+        /* write everything that starts before the cut, */
+        /* the rest gets parsed again with the next block */
+        cut = (end == gba->in.length) ? n : gba->opt.window;
+        for (i = 0; i < n && i < cut; i += path.len[i])
+            if (write_block(gba, &flags, &path, i, base + i))
+                goto write_error;
+        stats_phase(gba, DK_PHASE_EMIT, &t);
+        base += i;
     }
-    free(steps);
+    stats_path(gba, &path);
+    path_free(&path);
     return 0;
 write_error:
-    free(steps);
+    path_free(&path);
     return DK_ERROR_OOB_OUTPUT_W;
 }
-
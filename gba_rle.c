@@ -17,151 +17,225 @@ static int write_byte (struct COMPRESSOR *gba, unsigned char v) {
     return 0;
 }
 
-int gbarle_decompress (struct COMPRESSOR *gba) {
-    size_t output_size;
-
+/* check the header and read the decompressed size */
+int gbarle_size (struct COMPRESSOR *gba, size_t *size) {
     if (gba->in.length < 5)
         return DK_ERROR_INPUT_SMALL;
 
     if ((gba->in.data[0] & 0xF0) != 0x30)
         return DK_ERROR_SIG_WRONG;
 
-    output_size = (gba->in.data[3] << 16) | gba->in.data[1]
-                | (gba->in.data[2] <<  8);
+    *size = (gba->in.data[3] << 16) | gba->in.data[1]
+          | (gba->in.data[2] <<  8);
+    return 0;
+}
+
+/* the lower bits of the signature are ignored, but nothing sets them */
+int gbarle_probe (struct COMPRESSOR *gba) {
+    size_t size;
+    if (gbarle_size(gba, &size) || !size || gba->in.data[0] != 0x30)
+        return 0;
+    return 60;
+}
+
+int gbarle_decompress (struct COMPRESSOR *gba) {
+    size_t output_size;
+    enum DK_ERROR e;
+
+    if ((e = gbarle_size(gba, &output_size)))
+        return e;
     gba->in.pos += 4;
 
     while (gba->out.pos < output_size) {
-        int i, count, v;
+        size_t start = gba->out.pos;
+        int i, count, v, rle;
         if ((v = read_byte(gba)) < 0)
             return DK_ERROR_OOB_INPUT;
         count = v & 0x7F;
-        if (v & 0x80) {
+        rle   = v >> 7;
+        if ((size_t)count + (rle ? 3 : 1) > output_size - gba->out.pos)
+            stats_slow(gba);
+        if (rle) {
             count += 3;
             if ((v = read_byte(gba)) < 0)
                 return DK_ERROR_OOB_INPUT;
-            for (i = 0; i < count; i++)
+            /* (a block may run past the end of the output) */
+            for (i = 0; i < count && gba->out.pos < output_size; i++)
                 if (write_byte(gba, v))
                     return DK_ERROR_OOB_OUTPUT_W;
         }
         else {
             count += 1;
-            for (i = 0; i < count; i++) {
+            for (i = 0; i < count && gba->out.pos < output_size; i++) {
                 if ((v = read_byte(gba)) < 0)
                     return DK_ERROR_OOB_INPUT;
                 if (write_byte(gba, v))
                     return DK_ERROR_OOB_OUTPUT_W;
             }
         }
+        stats_case(gba, rle, gba->out.pos - start);
     }
     return 0;
 }
 
 
+/* streaming decompressor */
+/* the only state is the block that's in progress */
 
-struct PATH {
-    struct PATH *link;
-    size_t used;
-    struct NCASE { unsigned char rle:1, count:7; } ncase;
+struct RLE_STREAM {
+    unsigned count; /* bytes left in the current block */
+    int rle;        /* repeat value rather than copying input */
+    int value;
 };
 
+static int rle_stream_read (struct DK_STREAM *s) {
+    struct RLE_STREAM  *st  = s->state;
+    struct COMPRESSOR  *gba = &s->dc;
+    struct FILE_STREAM *out = &gba->out;
+
+    while (out->pos < out->limit && (s->done + out->pos) < s->size) {
+        int v;
+        if (!st->count) { /* next block */
+            if ((v = read_byte(gba)) < 0)
+                return DK_ERROR_OOB_INPUT;
+            st->rle   = !!(v & 0x80);
+            st->count = (v & 0x7F) + (st->rle ? 3 : 1);
+            if (st->rle && (st->value = read_byte(gba)) < 0)
+                return DK_ERROR_OOB_INPUT;
+        }
+        if (st->rle)
+            v = st->value;
+        else if ((v = read_byte(gba)) < 0)
+            return DK_ERROR_OOB_INPUT;
+        st->count--;
+        out->data[out->pos++] = v;
+    }
+    return 0;
+}
+
+int gbarle_stream (struct DK_STREAM *s) {
+    enum DK_ERROR e;
+    if ((e = gbarle_size(&s->dc, &s->size)))
+        return e;
+    s->dc.in.pos = 4;
+    s->state = calloc(1, sizeof(struct RLE_STREAM));
+    if (s->state == NULL)
+        return DK_ERROR_ALLOC;
+    s->read = rle_stream_read;
+    return 0;
+}
+
+
+
+/* each case is stored as its control byte */
+#define NCASE(rle, count) ((rle) << 7 | ((count) & 0x7F))
+
+/* every path to the end passes through one of the next 130 nodes, */
+/* so the cheapest of those is a lower bound for the final size */
+static int over_budget (struct COMPRESSOR *gba, struct DK_PATH *path, size_t i) {
+    uint32_t least = path_least(path, i, 130);
+    return least != PATH_UNSEEN
+        && OVER_BUDGET(gba, 4 + least);
+}
+
 int gbarle_compress (struct COMPRESSOR *gba) {
 
-    struct PATH *steps = malloc((gba->in.length+1) * sizeof(struct PATH));
-    struct PATH *step = NULL, *prev = NULL;
+    struct DK_PATH path;
+    double t = stats_start(gba);
     size_t i;
+    enum DK_ERROR e;
 
-    if (steps == NULL)
-        return DK_ERROR_ALLOC;
+    if ((e = path_init(&path, gba->in.length)))
+        return e;
 
     /* write header */
-    if (write_byte(gba, 0x30)
+    if (gba->dry_run)
+        gba->out.pos = 4;
+    else if (write_byte(gba, 0x30)
     ||  write_byte(gba, gba->in.length)
     ||  write_byte(gba, gba->in.length >>  8)
     ||  write_byte(gba, gba->in.length >> 16))
         goto write_error;
 
-    /* happy defaults */
-    for (i = 0; i <= gba->in.length; i++) {
-        static const struct PATH p = { NULL, (size_t)-1, { 0,0 } };
-        steps[i] = p;
-    }
-    steps[0].used = 0;
-
     /* determine the best path */
     for (i = 0; i < gba->in.length; i++) {
-        int a = read_byte(gba);
-        size_t count = 0, limit = 130;
+        int a;
+        size_t count, limit = 130;
 
-        /* count how many subsequent bytes match */
-        if (limit > (gba->in.length-i+1))
-            limit =  gba->in.length-i+1;
-        while (count++ < limit && a == read_byte(gba));
+        if (gba->opt.budget && !(i & 255) && over_budget(gba, &path, i)) {
+            path_free(&path);
+            return DK_ERROR_BUDGET;
+        }
+        if (dk_poll(gba, i, gba->in.length)) {
+            path_free(&path);
+            return DK_ERROR_CANCELLED;
+        }
+        a = read_byte(gba);
+
+        /* count how many bytes match, up to the longest run a block holds */
+        if (limit > (gba->in.length-i))
+            limit =  gba->in.length-i;
+        for (count = 1; count < limit && a == read_byte(gba); count++);
         gba->in.pos = i+1;
 
         /* test RLE cases */
-        for (; count >= 3; count--) {
-            struct PATH *next = &steps[i+count];
-            size_t used = steps[i].used + 2.0;
-            if (next->used > used) {
-                struct PATH p = { &steps[i], used, { 1, count - 3 } };
-                *next = p;
-            }
-        }
+        for (; count >= 3; count--)
+            path_test(&path, i, count, path.cost[i] + 2, NCASE(1, count - 3));
 
         /* test non-RLE cases */
         limit = 128;
         if (limit > (gba->in.length-i+1))
             limit = (gba->in.length-i+1);
-        for (count = 1; count < limit; count++) {
-            struct PATH *next = &steps[i+count];
-            size_t used = steps[i].used + 1.0 + count;
-            if (next->used > used) {
-                struct PATH p = { &steps[i], used, { 0, count - 1 } };
-                *next = p;
-            }
-        }
+        for (count = 1; count < limit; count++)
+            path_test(&path, i, count, path.cost[i] + 1 + count, NCASE(0, count - 1));
     }
 
-    /* reverse path direction */
-    prev = &steps[gba->in.length];
-    step = prev->link;
-    while (step != NULL) {
-        struct PATH *next = step->link;
-        step->link = prev;
-        prev = step;
-        step = next;
+    stats_phase(gba, DK_PHASE_SEARCH, &t);
+
+    if (OVER_BUDGET(gba, 4 + path.cost[gba->in.length])) {
+        path_free(&path);
+        return DK_ERROR_BUDGET;
+    }
+    if (gba->dry_run) {
+        gba->out.pos = 4 + path.cost[gba->in.length];
+        path_free(&path);
+        return 0;
     }
 
+    /* reverse path direction */
+    path_reverse(&path);
+    stats_phase(gba, DK_PHASE_REVERSE, &t);
+
     /* traverse the path and write data */
-    step = steps;
-    while (step != &steps[gba->in.length]) {
-        struct PATH   *next = step->link;
-        unsigned char *data = gba->in.data + (step - steps);
-        unsigned char count = next->ncase.count;
-        unsigned char type  = next->ncase.rle;
+    for (i = 0; i < gba->in.length; i += path.len[i]) {
+        unsigned char *data = gba->in.data + i;
+        unsigned char ctrl  = path.ncase[i + path.len[i]];
+        size_t j;
+
+        stats_case(gba, ctrl >> 7, path.len[i]);
 
         /* control byte */
-        if (write_byte(gba, count | (type << 7)))
+        if (write_byte(gba, ctrl))
             goto write_error;
 
         /* data bytes */
-        if (type) {
+        if (ctrl & 0x80) {
             if (write_byte(gba, *data))
                 goto write_error;
         }
         else {
-            for (i = 0; i < count+1u; i++) {
+            for (j = 0; j < (ctrl & 0x7Fu)+1; j++) {
                 if (write_byte(gba, *data++))
                     goto write_error;
             }
         }
-        step = next;
     }
+    stats_phase(gba, DK_PHASE_EMIT, &t);
+    stats_path(gba, &path);
 
-    free(steps);
+    path_free(&path);
     return 0;
 write_error:
-    free(steps);
+    path_free(&path);
     return DK_ERROR_OOB_OUTPUT_W;
 }
-
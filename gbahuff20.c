@@ -45,12 +45,9 @@ static int write_out (struct COMPRESSOR *gba, int bit) {
     return 0;
 }
 
-int gbahuff20_decompress (struct COMPRESSOR *gba) {
-
-    size_t output_size;
+/* check the header and read the decompressed size */
+int gbahuff20_size (struct COMPRESSOR *gba, size_t *size) {
     int data_size; /* how many bits per leaf */
-    int n    = 0;  /* current node position */
-    int node = 0;  /* previous node value */
 
     if (gba->in.length < 6)
         return DK_ERROR_EARLY_EOF;
@@ -66,9 +63,41 @@ int gbahuff20_decompress (struct COMPRESSOR *gba) {
         return DK_ERROR_HUFF_LEAF;
 
     /* size of the output data */
-    output_size =  gba->in.data[1]
-                | (gba->in.data[2] <<  8)
-                | (gba->in.data[3] << 16);
+    *size =  gba->in.data[1]
+          | (gba->in.data[2] <<  8)
+          | (gba->in.data[3] << 16);
+    return 0;
+}
+
+/* the tree has to end before the input does, and the children */
+/* of the root node have to be somewhere inside the tree       */
+int gbahuff20_probe (struct COMPRESSOR *gba) {
+    size_t size, data;
+    if (gbahuff20_size(gba, &size) || !size)
+        return 0;
+    data = 4+2*(gba->in.data[4]+1);
+    if (data >= gba->in.length
+    ||  6+2*(gba->in.data[5] & 0x3F)+1 >= (int)data)
+        return 0;
+
+    /* the bios reads the data a word at a time */
+    return (data & 3) ? 40 : 80;
+}
+
+int gbahuff20_decompress (struct COMPRESSOR *gba) {
+
+    size_t output_size;
+    int data_size = 8; /* how many bits per leaf */
+    int root, n, node; /* root node, current node position, previous node value */
+    enum DK_ERROR e;
+
+    if ((e = gbahuff20_size(gba, &output_size)))
+        return e;
+
+    /* every code starts at the root, which can have leaves of its own */
+    root = gba->in.data[5];
+    node = root;
+    n    = root & 0x3F;
 
     /* data offset */
     gba->in.pos = 4+2*(gba->in.data[4]+1);
@@ -84,7 +113,9 @@ int gbahuff20_decompress (struct COMPRESSOR *gba) {
             for (i = 0; i < data_size; i++)
                 if (write_out(gba, !!(node & (1 << i))) < 0)
                     return DK_ERROR_OOB_OUTPUT_W;
-            node = n = 0;
+            stats_case(gba, 0, 1);
+            node = root;
+            n    = root & 0x3F;
         }
         else { /* next is a node */
             if ((node = read_tree(gba, 6+2*n+dir)) < 0)
@@ -96,6 +127,57 @@ int gbahuff20_decompress (struct COMPRESSOR *gba) {
 }
 
 
+/* streaming decompressor */
+/* the bit position lives in the stream itself, and every leaf is a byte */
+
+struct HUFF20_STREAM {
+    int root; /* root node value */
+    int n;    /* current node position */
+    int node; /* previous node value */
+};
+
+static int huff20_stream_read (struct DK_STREAM *s) {
+    struct HUFF20_STREAM *st = s->state;
+    struct COMPRESSOR   *gba = &s->dc;
+
+    while (gba->out.pos < gba->out.limit && (s->done + gba->out.pos) < s->size) {
+        int dir = read_bit(gba);
+        if (dir < 0)
+            return DK_ERROR_OOB_INPUT;
+        if ((!dir && (st->node & 0x80))
+        || (  dir && (st->node & 0x40))) { /* next is a leaf */
+            if ((st->node = read_tree(gba, 6+2*st->n+dir)) < 0)
+                return DK_ERROR_OOB_INPUT;
+            gba->out.data[gba->out.pos++] = st->node;
+            st->node = st->root;
+            st->n    = st->root & 0x3F;
+        }
+        else { /* next is a node */
+            if ((st->node = read_tree(gba, 6+2*st->n+dir)) < 0)
+                return DK_ERROR_OOB_INPUT;
+            st->n += (st->node & 0x3F)+1;
+        }
+    }
+    return 0;
+}
+
+int gbahuff20_stream (struct DK_STREAM *s) {
+    struct HUFF20_STREAM *st;
+    enum DK_ERROR e;
+    if ((e = gbahuff20_size(&s->dc, &s->size)))
+        return e;
+    s->dc.in.pos = 4+2*(s->dc.in.data[4]+1);
+    if ((st = calloc(1, sizeof(struct HUFF20_STREAM))) == NULL)
+        return DK_ERROR_ALLOC;
+    st->root = s->dc.in.data[5];
+    st->node = st->root;
+    st->n    = st->root & 0x3F;
+    s->state = st;
+    s->read  = huff20_stream_read;
+    return 0;
+}
+
+
 
 
 
@@ -160,6 +242,14 @@ static void generate_leaves (struct BIN *bin) {
         if (!count[i].count)
             break;
 
+    /* a tree needs two leaves, so give a lone value an unused partner */
+    if (i == 1) {
+        struct NODE *leaf = &bin->tree[bin->node_count++];
+        leaf->type  = CLEAF;
+        leaf->count = 0;
+        leaf->value = (count[0].index + 1) & 255;
+    }
+
     /* enqueue every leaf */
     while (i--) {
         struct NODE *leaf = &bin->tree[bin->node_count++];
@@ -437,6 +527,8 @@ static int encode_data (struct BIN *bin) {
     size_t i;
     for (i = 0; i < gba->in.length; i++) {
         struct VLUT v = bin->vlut[gba->in.data[i]];
+        if (dk_poll(gba, i, gba->in.length))
+            return DK_ERROR_CANCELLED;
         while (v.bits--) {
             if (write_bit(gba, v.sequence & 1))
                 return DK_ERROR_OOB_OUTPUT_W;
@@ -454,6 +546,7 @@ static int encode_data (struct BIN *bin) {
 int gbahuff20_compress (struct COMPRESSOR *gba) {
 
     struct BIN bin = { gba, {{0}}, {{0}}, NULL, 0 };
+    double t = stats_start(gba);
     enum DK_ERROR e;
 
     if (gba->out.limit <= 520)
@@ -463,9 +556,12 @@ int gbahuff20_compress (struct COMPRESSOR *gba) {
     generate_tree  (&bin);
     create_lut     (&bin);
 
-    if ((e = gba_header (&bin))
-    ||  (e = encode_data(&bin)))
+    if ((e = gba_header (&bin)))
+        return e;
+    stats_phase(gba, DK_PHASE_SETUP, &t);
+    if ((e = encode_data(&bin)))
         return e;
+    stats_phase(gba, DK_PHASE_EMIT, &t);
 
     return 0;
 }
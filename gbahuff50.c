@@ -102,6 +102,50 @@ int read_header (struct COMPRESSOR *gba, size_t *length) {
     return 0;
 }
 
+/* check the header and read the decompressed size */
+int gbahuff50_size (struct COMPRESSOR *gba, size_t *size) {
+    if (gba->in.length < 4)
+        return DK_ERROR_INPUT_SMALL;
+    if (gba->in.data[0] != 0x50)
+        return DK_ERROR_SIG_WRONG;
+    *size =  gba->in.data[1]
+          | (gba->in.data[2] <<  8)
+          | (gba->in.data[3] << 16);
+    return 0;
+}
+
+/* walk the frequency tables the same way init_nodes does, */
+/* without building anything from them                     */
+int gbahuff50_probe (struct COMPRESSOR *gba) {
+    struct FILE_STREAM *in = &gba->in;
+    size_t size, pos = 4;
+    int count = 0, last = -1, sorted = 1;
+
+    if (gbahuff50_size(gba, &size) || !size)
+        return 0;
+
+    for (;;) {
+        int a, b;
+        if (pos + 2 > in->length)
+            return 0;
+        a = in->data[pos++];
+        b = in->data[pos++];
+        if (count && !a)
+            break;
+        if (a > b || (count += b-a+1) > 256)
+            return 0;
+        if (a <= last) /* (the compressor writes them in order) */
+            sorted = 0;
+        last = b;
+        pos += b-a+1;
+    }
+
+    /* there has to be something left to decode */
+    if (pos >= in->length)
+        return 0;
+    return sorted ? 80 : 30;
+}
+
 /* sort by count and index ascending, with zero counts at the end */
 static int sort_nodes (const void *aa, const void *bb) {
     const struct NODE *a = aa, *b = bb;
@@ -240,6 +284,7 @@ static int decode_input (struct BIN *bin) {
                 break;
             if (write_byte(bin->gba, current->value))
                 return DK_ERROR_OOB_OUTPUT_W;
+            stats_case(bin->gba, 0, 1);
             current = bin->root;
         }
     }
@@ -256,10 +301,14 @@ int gbahuff50_decompress (struct COMPRESSOR *gba) {
 
     if ((e = read_header (gba, &length))
     ||  (e = init_nodes  (&bin))
-    ||  (e = init_tree   (&bin))
-    ||  (e = decode_input(&bin)))
+    ||  (e = init_tree   (&bin)))
         return e;
 
+    /* running out of space means the header size is wrong */
+    if ((e = decode_input(&bin)))
+        return (e == DK_ERROR_OOB_OUTPUT_W && gba->out.pos >= length)
+             ? DK_ERROR_SIZE_WRONG : e;
+
     if (gba->out.pos != length)
         return DK_ERROR_SIZE_WRONG;
 
@@ -267,6 +316,64 @@ int gbahuff50_decompress (struct COMPRESSOR *gba) {
 }
 
 
+/* streaming decompressor */
+/* the tree is built up front and kept for the lifetime of the stream */
+
+struct HUFF50_STREAM {
+    struct BIN bin;
+    int quit;
+};
+
+static int huff50_stream_read (struct DK_STREAM *s) {
+    struct HUFF50_STREAM *st = s->state;
+    struct COMPRESSOR   *gba = &s->dc;
+
+    while (!st->quit && gba->out.pos < gba->out.limit) {
+        struct NODE *current = st->bin.root;
+        do {
+            int bit;
+            if ((bit = read_bit(gba)) < 0)
+                return DK_ERROR_OOB_INPUT;
+            current = bit ? current->dir.right : current->dir.left;
+        } while (current->type != CLEAF);
+
+        if (current->value == 256) { /* quit */
+            st->quit = 1;
+            break;
+        }
+        if ((s->done + gba->out.pos) >= s->size)
+            return DK_ERROR_SIZE_WRONG;
+        gba->out.data[gba->out.pos++] = current->value;
+    }
+
+    if (st->quit && (s->done + gba->out.pos) != s->size)
+        return DK_ERROR_SIZE_WRONG;
+    return 0;
+}
+
+int gbahuff50_stream (struct DK_STREAM *s) {
+    struct HUFF50_STREAM *st;
+    enum DK_ERROR e;
+
+    if ((e = gbahuff50_size(&s->dc, &s->size)))
+        return e;
+
+    st = calloc(1, sizeof(struct HUFF50_STREAM));
+    if (st == NULL)
+        return DK_ERROR_ALLOC;
+    s->state  = st; /* (freed by the caller, even on error) */
+    st->bin.gba = &s->dc;
+
+    if ((e = read_header(&s->dc, &s->size))
+    ||  (e = init_nodes (&st->bin))
+    ||  (e = init_tree  (&st->bin)))
+        return e;
+
+    s->read = huff50_stream_read;
+    return 0;
+}
+
+
 
 
 
@@ -451,6 +558,8 @@ static int encode_output (struct BIN *bin) {
     /* encode each byte from input */
     while (bin->gba->in.pos < bin->gba->in.length) {
         int c;
+        if (dk_poll(bin->gba, bin->gba->in.pos, bin->gba->in.length))
+            return DK_ERROR_CANCELLED;
         if ((c = read_byte(bin->gba)) < 0)
             return DK_ERROR_OOB_INPUT;
         if (write_pattern(bin, bin->vlut[c]))
@@ -469,15 +578,19 @@ static int encode_output (struct BIN *bin) {
 
 int gbahuff50_compress (struct COMPRESSOR *gba) {
     struct BIN bin;
+    double t = stats_start(gba);
     enum DK_ERROR e;
 
     memset(&bin, 0, sizeof(struct BIN));
     bin.gba = gba;
 
     if ((e = init_bytes   (&bin))
-    ||  (e = init_tree    (&bin))
-    ||  (e = encode_output(&bin)))
+    ||  (e = init_tree    (&bin)))
+        return e;
+    stats_phase(gba, DK_PHASE_SETUP, &t);
+    if ((e = encode_output(&bin)))
         return e;
+    stats_phase(gba, DK_PHASE_EMIT, &t);
 
     return 0;
 }
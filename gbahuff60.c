@@ -163,93 +163,182 @@ static void update_weights (struct BIN *bin, int node) {
     }
 }
 
+/* check the header and read the decompressed size */
+int gbahuff60_size (struct COMPRESSOR *gba, size_t *size) {
+    if (gba->in.length < 4)
+        return DK_ERROR_INPUT_SMALL;
+    if (gba->in.data[0] != 0x60)
+        return DK_ERROR_SIG_WRONG;
+    *size =  gba->in.data[1]
+          | (gba->in.data[2] <<  8)
+          | (gba->in.data[3] << 16);
+    return 0;
+}
+
+/* the tree starts with only the quit and new leaf codes, */
+/* and anything that isn't empty has to start with a new one */
+int gbahuff60_probe (struct COMPRESSOR *gba) {
+    size_t size;
+    if (gbahuff60_size(gba, &size) || !size || gba->in.length < 6)
+        return 0;
+    if (!(gba->in.data[4] & 1))
+        return 0;
+    return 80;
+}
+
+/* decode the next value and update the tree to match */
+/* sets *out to -1 when the quit command is encountered */
+static int next_value (struct BIN *bin, int *node_count, int *out) {
+    struct NODE *tree = bin->tree;
+    int node = 0;
+    int i;
+
+    /* traverse the tree for a value */
+    while (tree[node].type == CNODE) {
+        switch (read_bit(bin->gba)) {
+            case 0: { node = tree[node].dir.L; break; }
+            case 1: { node = tree[node].dir.R; break; }
+           default: { return DK_ERROR_OOB_INPUT; }
+        }
+    }
+
+    /* process the value */
+    *out = 0;
+    switch (tree[node].val) {
+           default: { *out = tree[node].val; stats_case(bin->gba, 0, 1); break; }
+        case 0x100: { *out = -1; return 0; } /* quit */
+        case 0x101: {
+            enum DK_ERROR e;
+            stats_case(bin->gba, 1, 1);
+            for (i = 0; i < 8; i++) {
+                int bit;
+                if ((bit = read_bit(bin->gba)) < 0)
+                    return DK_ERROR_OOB_INPUT;
+                *out <<= 1;
+                *out |= bit;
+            }
+            if ((e = add_leaf(bin, &node, *node_count, *out)))
+                return e;
+            *node_count += 2;
+            break;
+        }
+    }
+
+    /* rebuild the tree if root weight exceeds 0x8000 */
+    if (tree->weight >= 0x8000) {
+        rebuild_tree(bin, *node_count);
+
+        /* the old node pointer is invalid after rebuilding the tree */
+        for (i = 0; i < *node_count; i++)
+            if (tree[i].type == CLEAF
+            &&  tree[i].val  == *out)
+                break;
+        node = i;
+    }
+
+    update_weights(bin, node);
+    return 0;
+}
+
+/* tree consists of:
+     - two special leafs     (the "new value" and "quit" commands)
+     - up to 256 value leafs (each unique byte encountered so far)
+     - nodes to connect every leaf
+*/
+static const struct NODE initial_tree[3] = {
+    {CNODE, 2, -1, .dir.L = 1, .dir.R = 2 },
+    {CLEAF, 1,  0, .val = 0x100 }, /* quit */
+    {CLEAF, 1,  0, .val = 0x101 }  /* new leaf */
+};
+
 int gbahuff60_decompress (struct COMPRESSOR *gba) {
 
-    /* tree consists of:
-         - two special leafs     (the "new value" and "quit" commands)
-         - up to 256 value leafs (each unique byte encountered so far)
-         - nodes to connect every leaf
-    */
-    struct NODE tree[NODE_LIMIT] = {
-        {CNODE, 2, -1, .dir.L = 1, .dir.R = 2 },
-        {CLEAF, 1,  0, .val = 0x100 }, /* quit */
-        {CLEAF, 1,  0, .val = 0x101 }  /* new leaf */
-    };
+    struct NODE tree[NODE_LIMIT];
     int node_count = 3;
     struct BIN bin = { gba, tree };
     size_t data_length;
     enum DK_ERROR e;
 
+    memcpy(tree, initial_tree, sizeof(initial_tree));
+
     /* check the header */
-    if (gba->in.length < 4)
-        return DK_ERROR_INPUT_SMALL;
-    if (gba->in.data[0] != 0x60)
-        return DK_ERROR_SIG_WRONG;
-    data_length =  gba->in.data[1]
-                | (gba->in.data[2] <<  8)
-                | (gba->in.data[3] << 16);
+    if ((e = gbahuff60_size(gba, &data_length)))
+        return e;
     gba->in.pos = 4;
 
 
     /* process the data */
     for (;;) {
-        int out  = 0;
-        int quit = 0;
-        int node = 0;
-        int i;
-
-        /* traverse the tree for a value */
-        while (tree[node].type == CNODE) {
-            switch (read_bit(gba)) {
-                case 0: { node = tree[node].dir.L; break; }
-                case 1: { node = tree[node].dir.R; break; }
-               default: { return DK_ERROR_OOB_INPUT; }
-            }
-        }
-
-        /* process the value */
-        switch (tree[node].val) {
-               default: { out = tree[node].val; break; }
-            case 0x100: { quit = 1; break; }
-            case 0x101: {
-                for (i = 0; i < 8; i++) {
-                    int bit;
-                    if ((bit = read_bit(gba)) < 0)
-                        return DK_ERROR_OOB_INPUT;
-                    out <<= 1;
-                    out |= bit;
-                }
-                if ((e = add_leaf(&bin, &node, node_count, out)))
-                    return e;
-                node_count += 2;
-                break;
-            }
-        }
-        if (quit)
+        int out;
+        if ((e = next_value(&bin, &node_count, &out)))
+            return e;
+        if (out < 0)
             break;
         if (write_byte(gba, out))
-            return DK_ERROR_OOB_OUTPUT_W;
+            return (gba->out.pos >= data_length)
+                 ? DK_ERROR_SIZE_WRONG : DK_ERROR_OOB_OUTPUT_W;
         if (gba->out.pos > data_length)
             return DK_ERROR_SIZE_WRONG;
+    }
 
-        /* rebuild the tree if root weight exceeds 0x8000 */
-        if (tree->weight >= 0x8000) {
-            rebuild_tree(&bin, node_count);
+    if (gba->out.pos != data_length)
+        return DK_ERROR_SIZE_WRONG;
 
-            /* the old node pointer is invalid after rebuilding the tree */
-            for (i = 0; i < node_count; i++)
-                if (bin.tree[i].type == CLEAF
-                &&  bin.tree[i].val  == out)
-                    break;
-            node = i;
-        }
+    return 0;
+}
 
-        update_weights(&bin, node);
+
+/* streaming decompressor */
+/* the adaptive tree is all the state there is */
+
+struct HUFF60_STREAM {
+    struct NODE tree[NODE_LIMIT];
+    struct BIN bin;
+    int node_count;
+    int quit;
+};
+
+static int huff60_stream_read (struct DK_STREAM *s) {
+    struct HUFF60_STREAM *st = s->state;
+    struct COMPRESSOR   *gba = &s->dc;
+    enum DK_ERROR e;
+
+    while (!st->quit && gba->out.pos < gba->out.limit) {
+        int out;
+        if ((e = next_value(&st->bin, &st->node_count, &out)))
+            return e;
+        if (out < 0) {
+            st->quit = 1;
+            break;
+        }
+        if ((s->done + gba->out.pos) >= s->size)
+            return DK_ERROR_SIZE_WRONG;
+        gba->out.data[gba->out.pos++] = out;
     }
 
-    if (gba->out.pos != data_length)
+    if (st->quit && (s->done + gba->out.pos) != s->size)
         return DK_ERROR_SIZE_WRONG;
+    return 0;
+}
+
+int gbahuff60_stream (struct DK_STREAM *s) {
+    struct HUFF60_STREAM *st;
+    enum DK_ERROR e;
 
+    if ((e = gbahuff60_size(&s->dc, &s->size)))
+        return e;
+    s->dc.in.pos = 4;
+
+    st = calloc(1, sizeof(struct HUFF60_STREAM));
+    if (st == NULL)
+        return DK_ERROR_ALLOC;
+    memcpy(st->tree, initial_tree, sizeof(initial_tree));
+    st->bin.gba    = &s->dc;
+    st->bin.tree   = st->tree;
+    st->node_count = 3;
+
+    s->state = st;
+    s->read  = huff60_stream_read;
     return 0;
 }
 
@@ -315,6 +404,7 @@ int gbahuff60_compress (struct COMPRESSOR *gba) {
     };
     int node_count = 3;
     struct BIN bin = { gba, tree };
+    double t = stats_start(gba);
     enum DK_ERROR e;
 
     /* write header */
@@ -326,9 +416,12 @@ int gbahuff60_compress (struct COMPRESSOR *gba) {
 
     /* process data */
     while (gba->in.pos < gba->in.length) {
-        int  val = gba->in.data[gba->in.pos++];
-        int node = nsearch(tree, node_count, val);
-        int i;
+        int  val, node, i;
+        if (dk_poll(gba, gba->in.pos, gba->in.length))
+            return DK_ERROR_CANCELLED;
+        val  = gba->in.data[gba->in.pos++];
+        node = nsearch(tree, node_count, val);
+        stats_case(gba, !node, 1);
         if (!node) { /* leaf not present in tree, so add a new leaf */
 
             /* send the new leaf command */
@@ -364,6 +457,7 @@ int gbahuff60_compress (struct COMPRESSOR *gba) {
 
         update_weights(&bin, node);
     }
+    stats_phase(gba, DK_PHASE_EMIT, &t);
 
     /* quit */
     if ((e = encode_leaf(&bin, &tree[nsearch(tree, node_count, 0x100)])))
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - generated inputs for the benchmark */
+
+/* random bytes say very little about these compressors, so the data */
+/* is built to look like what they'd see in the games: planar tiles  */
+/* drawn with a handful of colours, and tilemaps made of runs of     */
+/* repeated or counting entries, drawn from a pool of recent values  */
+
+#include <string.h>
+#include "gen_util.h"
+
+#define POOL_LIMIT 64
+
+struct GEN {
+    const struct GEN_PARAMS *p;
+    uint64_t state;
+    unsigned pool[POOL_LIMIT];
+    unsigned pool_count;
+};
+
+/* splitmix64 */
+static uint64_t next (struct GEN *g) {
+    uint64_t z = (g->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static unsigned range (struct GEN *g, unsigned n) {
+    return n ? (unsigned)((next(g) >> 32) % n) : 0;
+}
+
+static int chance (struct GEN *g, unsigned percent) {
+    return range(g, 100) < percent;
+}
+
+/* anywhere from min up to the longest run */
+static unsigned run_length (struct GEN *g, unsigned min) {
+    unsigned max = (g->p->run > min) ? g->p->run : min;
+    return min + range(g, max - min + 1);
+}
+
+/* either a recent value or the fresh one, which is then remembered */
+static unsigned pick (struct GEN *g, unsigned fresh) {
+    unsigned size = (g->p->pool < POOL_LIMIT) ? g->p->pool : POOL_LIMIT;
+    if (g->pool_count && chance(g, g->p->repeat))
+        return g->pool[range(g, g->pool_count)];
+    if (g->pool_count < size)
+        g->pool[g->pool_count++] = fresh;
+    else if (size)
+        g->pool[range(g, size)] = fresh;
+    return fresh;
+}
+
+
+
+
+static void fill_random (struct GEN *g, unsigned char *data, size_t size) {
+    size_t i;
+    for (i = 0; i < size; i++)
+        data[i] = next(g) >> 56;
+}
+
+/* rows are drawn in runs of one colour, and often repeat the row above */
+static void fill_tiles (struct GEN *g, unsigned char *data, size_t size, int bpp) {
+    size_t tile_size = bpp * 8;
+    unsigned count = g->p->colours;
+    size_t i;
+
+    if (count < 1)         count = 1;
+    if (count > 1u << bpp) count = 1u << bpp;
+
+    memset(data, 0, size);
+    for (i = 0; i + tile_size <= size; i += tile_size) {
+        unsigned char colours[16], row_pixels[8];
+        unsigned c, row, x;
+
+        colours[0] = 0; /* (every tile has some transparency) */
+        for (c = 1; c < count; c++)
+            colours[c] = range(g, 1 << bpp);
+
+        for (row = 0; row < 8; row++) {
+            unsigned plane, left = 0;
+            if (!row || !chance(g, g->p->repeat)) {
+                for (x = 0; x < 8; x++) {
+                    if (!left) {
+                        c = colours[range(g, count)];
+                        left = run_length(g, 1);
+                    }
+                    row_pixels[x] = c;
+                    left--;
+                }
+            }
+            /* SNES/GB planar layout, planes 2 and 3 follow 0 and 1 */
+            for (x = 0; x < 8; x++)
+                for (plane = 0; plane < (unsigned)bpp; plane++)
+                    if (row_pixels[x] & (1 << plane))
+                        data[i + row*2 + (plane & 1) + (plane >> 1)*16] |= 0x80 >> x;
+        }
+    }
+}
+
+/* tile numbers wander around near each other, palettes rarely change */
+/* and the high bits (priority and flips) are mostly clear */
+static void fill_snes_tilemap (struct GEN *g, unsigned char *data, size_t size) {
+    unsigned tile = range(g, 0x400), palette = range(g, 8);
+    size_t i = 0;
+
+    while (i + 1 < size) {
+        unsigned len  = run_length(g, 1);
+        unsigned step = chance(g, g->p->increment);
+        unsigned v;
+
+        tile = (tile + range(g, 64) - 32) & 0x3FF;
+        if (!range(g, 8))
+            palette = range(g, 8);
+        v = pick(g, tile | (palette << 10)
+                         | (!range(g, 4) << 13)
+                         | (!range(g, 8) << 14)
+                         | (!range(g, 8) << 15));
+
+        while (len-- && i + 1 < size) {
+            data[i++] = v;
+            data[i++] = v >> 8;
+            v = (v & ~0x3FFu) | ((v + step) & 0x3FF);
+        }
+    }
+    if (i < size)
+        data[i] = 0;
+}
+
+/* runs of one byte, counting bytes, or bytes sharing an upper nibble. */
+/* DKL can't write bytes above 0xBD on their own, so runs (including  */
+/* the last one) are at least four bytes long and counting never wraps */
+/* around. a short run of nibbles can't use 0xE as the upper nibble.   */
+static void fill_dkl_tilemap (struct GEN *g, unsigned char *data, size_t size) {
+    size_t i = 0;
+
+    while (i < size) {
+        unsigned len  = run_length(g, 4);
+        unsigned kind = range(g, 100);
+        unsigned v    = pick(g, range(g, 256));
+
+        if (size - i < len + 4)
+            len = size - i;
+        if (kind < g->p->increment && v + len > 256)
+            v = 256 - len;
+        if (kind >= (100 + g->p->increment) / 2 && (v & 0xF0) == 0xE0 && len < 20)
+            v ^= 0x10;
+
+        while (len-- && i < size) {
+            if (kind < g->p->increment)
+                data[i++] = v++;
+            else if (kind < (100 + g->p->increment) / 2)
+                data[i++] = v;
+            else
+                data[i++] = (v & 0xF0) | range(g, 16);
+        }
+    }
+}
+
+
+
+
+static const struct SHAPE {
+    const char *name;
+    struct GEN_PARAMS defaults;
+} shapes[] = {
+    [GEN_ZERO        ] = { "zero",         { 1,  0,  0,  0,  0, 0 } },
+    [GEN_RANDOM      ] = { "random",       { 1,  0,  0,  0,  0, 0 } },
+    [GEN_TILES_2BPP  ] = { "tiles_2bpp",   { 1,  4, 30,  0,  0, 4 } },
+    [GEN_TILES_4BPP  ] = { "tiles_4bpp",   { 1,  4, 30,  0,  0, 6 } },
+    [GEN_SNES_TILEMAP] = { "snes_tilemap", { 1,  8, 40, 40, 16, 0 } },
+    [GEN_DKL_TILEMAP ] = { "dkl_tilemap",  { 1, 16, 30, 30, 16, 0 } }
+};
+
+void gen_defaults (enum GEN_SHAPE shape, struct GEN_PARAMS *p) {
+    *p = shapes[shape].defaults;
+}
+
+const char *gen_name (enum GEN_SHAPE shape) {
+    return shapes[shape].name;
+}
+
+int gen_shape (const char *name) {
+    int i;
+    for (i = 0; i < GEN_LIMIT; i++)
+        if (!strcmp(name, shapes[i].name))
+            return i;
+    return -1;
+}
+
+void gen_fill (
+    enum GEN_SHAPE shape,
+    const struct GEN_PARAMS *p,
+    unsigned char *data,
+    size_t size
+) {
+    struct GEN g;
+    memset(&g, 0, sizeof(struct GEN));
+    g.p     = p;
+    g.state = p->seed;
+
+    switch (shape) {
+        case GEN_ZERO:         { memset(data, 0, size);             break; }
+        case GEN_RANDOM:       { fill_random(&g, data, size);       break; }
+        case GEN_TILES_2BPP:   { fill_tiles(&g, data, size, 2);     break; }
+        case GEN_TILES_4BPP:   { fill_tiles(&g, data, size, 4);     break; }
+        case GEN_SNES_TILEMAP: { fill_snes_tilemap(&g, data, size); break; }
+        case GEN_DKL_TILEMAP:  { fill_dkl_tilemap(&g, data, size);  break; }
+        default: break;
+    }
+}
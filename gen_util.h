@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - generated inputs for the benchmark */
+
+#ifndef DK_GEN
+#define DK_GEN
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the kinds of data the compressors were made for, plus two extremes */
+enum GEN_SHAPE {
+    GEN_ZERO,
+    GEN_RANDOM,
+    GEN_TILES_2BPP,   /* planar tiles, 16 bytes each */
+    GEN_TILES_4BPP,   /* planar tiles, 32 bytes each */
+    GEN_SNES_TILEMAP, /* 16-bit entries: tile, palette, priority and flips */
+    GEN_DKL_TILEMAP,  /* 8-bit tile numbers, often sharing an upper nibble */
+    GEN_LIMIT
+};
+
+/* the same seed and settings always give the same data */
+struct GEN_PARAMS {
+    uint64_t seed;
+    unsigned run;       /* longest run of one value or sequence */
+    unsigned repeat;    /* percentage of runs that reuse a recent value */
+    unsigned increment; /* percentage of runs that count upwards */
+    unsigned pool;      /* how many recent values are remembered */
+    unsigned colours;   /* colours per tile (tiles only) */
+};
+
+/* fill in the settings that suit a shape */
+void gen_defaults (enum GEN_SHAPE, struct GEN_PARAMS*);
+
+/* name of a shape, and the reverse (-1 if it's unknown) */
+const char *gen_name (enum GEN_SHAPE);
+int gen_shape (const char *name);
+
+void gen_fill (
+    enum GEN_SHAPE,
+    const struct GEN_PARAMS*,
+    unsigned char *data,
+    size_t size
+);
+
+#endif
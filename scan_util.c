@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - ROM scanning utility */
+
+/* the image is split into regions which are handed out to threads, */
+/* and the results are printed in order once they've all finished   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#if !defined(__WIN32__)
+#include <unistd.h>
+#endif
+#include "dkcomp.h"
+#include "batch_util.h"
+
+static const struct DK_ID {
+    enum DK_FORMAT id;
+    char *name;
+} formats[] = {
+    {        BD_COMP, "SNES DKC2/DKC3 Big Data"    },
+    {        SD_COMP, "SNES DKC3 Small Data"       },
+    {    DKCCHR_COMP, "SNES DKC Tilesets"          },
+    {    DKCGBC_COMP, " GBC DKC Tilemaps"          },
+    {       DKL_COMP, " GB  DKL/DKL2/DKL3 Tilemaps"},
+    {  GBA_LZ77_COMP, " GBA BIOS LZ77 (10)"        },
+    {GBA_HUFF20_COMP, " GBA BIOS Huffman (20)"     },
+    {   GBA_RLE_COMP, " GBA BIOS RLE (30)"         },
+    {GBA_HUFF50_COMP, " GBA Huffman (50)"          },
+    {GBA_HUFF60_COMP, " GBA Huffman (60)"          },
+    {       GBA_COMP, " GBA BIOS Auto-Detect"      },
+    {GB_PRINTER_COMP, " GB  Printer"               }
+};
+static const int format_count = sizeof(formats) / sizeof(struct DK_ID);
+
+#define REGION_SIZE 0x10000
+
+struct REGION {
+    size_t start, end;
+    struct DK_SCAN_RESULT *results;
+    size_t count;
+    int error;
+};
+
+struct SCANNER {
+    unsigned char *rom;
+    size_t rom_size;
+    struct DK_SCAN_OPTIONS opt; /* (start and end are set per region) */
+    struct REGION *regions;
+    size_t region_count;
+    size_t next; /* next region to hand out */
+    pthread_mutex_t lock;
+};
+
+static double now (void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static unsigned cpu_count (void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return n > 256 ? 256 : n;
+#endif
+    return 4;
+}
+
+static void *worker (void *arg) {
+    struct SCANNER *s = arg;
+    for (;;) {
+        struct DK_SCAN_OPTIONS opt = s->opt;
+        struct REGION *r;
+        size_t i;
+
+        pthread_mutex_lock(&s->lock);
+        i = s->next++;
+        pthread_mutex_unlock(&s->lock);
+        if (i >= s->region_count)
+            break;
+
+        r = &s->regions[i];
+        opt.start = r->start;
+        opt.end   = r->end;
+        r->error  = dk_scan(s->rom, s->rom_size, &opt, &r->results, &r->count);
+    }
+    return NULL;
+}
+
+static void run_scan (struct SCANNER *s, unsigned threads) {
+    pthread_t thread[256];
+    unsigned i, started = 0;
+
+    if (threads > s->region_count)
+        threads = s->region_count;
+
+    for (i = 0; i < threads; i++)
+        if (!pthread_create(&thread[i], NULL, worker, s))
+            started++;
+    if (!started) /* do it ourselves */
+        worker(s);
+    for (i = 0; i < started; i++)
+        pthread_join(thread[i], NULL);
+}
+
+static void usage (void) {
+    int i;
+    puts("Usage: ./dkscan ROM [OPTIONS]\n\n"
+         "Options:\n"
+         "  --format NUM    look for this format (can be repeated, the default\n"
+         "                  is Big Data and the GBA formats, which have headers)\n"
+         "  --start OFFSET  where to start scanning\n"
+         "  --end OFFSET    where to stop scanning\n"
+         "  --align NUM     only try offsets that are multiples of this\n"
+         "  --min SIZE      ignore anything that decodes to less (default 16)\n"
+         "  --max SIZE      ignore anything that decodes to more (default 262144)\n"
+         "  --threads NUM   how many threads to use\n\n"
+         "Formats:");
+    for (i = 0; i < format_count; i++)
+        printf("  %2d - %s\n", i, formats[i].name);
+}
+
+int main (int argc, char *argv[]) {
+
+    enum DK_FORMAT wanted[COMP_LIMIT];
+    struct SCANNER s;
+    size_t start = 0, end = 0, i, total = 0;
+    unsigned threads = cpu_count();
+    double time;
+    int e, n = 0, failed = 0;
+
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+
+    memset(&s, 0, sizeof(struct SCANNER));
+    for (i = 2; i < (size_t)argc; i++) {
+        if (i + 1 < (size_t)argc && !strcmp(argv[i], "--format")) {
+            int format = strtol(argv[++i], NULL, 0);
+            if (format < 0 || format >= format_count) {
+                fprintf(stderr, "Unsupported decompression format.\n");
+                return 1;
+            }
+            if (n < COMP_LIMIT)
+                wanted[n++] = formats[format].id;
+        }
+        else if (i + 1 < (size_t)argc && !strcmp(argv[i], "--start"))
+            start = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < (size_t)argc && !strcmp(argv[i], "--end"))
+            end = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < (size_t)argc && !strcmp(argv[i], "--align"))
+            s.opt.align = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < (size_t)argc && !strcmp(argv[i], "--min"))
+            s.opt.min_output = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < (size_t)argc && !strcmp(argv[i], "--max"))
+            s.opt.max_output = strtoull(argv[++i], NULL, 0);
+        else if (i + 1 < (size_t)argc && !strcmp(argv[i], "--threads")) {
+            threads = strtol(argv[++i], NULL, 0);
+            if (!threads || threads > 256) {
+                fprintf(stderr, "thread count should be between 1 and 256\n");
+                return 1;
+            }
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (n) {
+        s.opt.formats      = wanted;
+        s.opt.format_count = n;
+    }
+
+    if ((e = batch_read(argv[1], &s.rom, &s.rom_size))) {
+        fprintf(stderr, "Error: %s.\n", dk_get_error(e));
+        return 1;
+    }
+    if (!end || end > s.rom_size)
+        end = s.rom_size;
+
+    /* split the image into regions */
+    s.region_count = (start < end) ? (end - start + REGION_SIZE - 1) / REGION_SIZE : 0;
+    if (s.region_count
+    && (s.regions = calloc(s.region_count, sizeof(struct REGION))) == NULL) {
+        fprintf(stderr, "Error: %s.\n", dk_get_error(DK_ERROR_ALLOC));
+        free(s.rom);
+        return 1;
+    }
+    for (i = 0; i < s.region_count; i++) {
+        s.regions[i].start = start + i * REGION_SIZE;
+        s.regions[i].end   = s.regions[i].start + REGION_SIZE;
+        if (s.regions[i].end > end)
+            s.regions[i].end = end;
+    }
+
+    pthread_mutex_init(&s.lock, NULL);
+    time = now();
+    run_scan(&s, threads);
+    time = now() - time;
+    pthread_mutex_destroy(&s.lock);
+
+    puts("  Offset  Format                          Compressed  Decompressed  Score");
+    for (i = 0; i < s.region_count; i++) {
+        struct REGION *r = &s.regions[i];
+        size_t j;
+        if (r->error) {
+            fprintf(stderr, "Error at 0x%06zX: %s.\n", r->start, dk_get_error(r->error));
+            failed = 1;
+        }
+        for (j = 0; j < r->count; j++) {
+            struct DK_SCAN_RESULT *res = &r->results[j];
+            printf("0x%06zX  %2d %-28s  %10zu  %12zu  %5d\n",
+                   res->offset, res->format, formats[res->format].name,
+                   res->compressed_size, res->decompressed_size, res->score);
+        }
+        total += r->count;
+        free(r->results);
+    }
+    fprintf(stderr, "Found %zu in %.3f seconds.\n", total, time);
+
+    free(s.regions);
+    free(s.rom);
+    return failed;
+}
@@ -4,33 +4,55 @@
 
 #if defined(__WIN32__)
 #include <winsock2.h>
-#else
-#include <unistd.h>
 #endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <microhttpd.h>
 #include <dkcomp.h>
-
-enum PRG_STATE {
-    PRG_RUNNING,
-    PRG_QUIT
+#include "server.h"
+
+/* requests are handled by a pool of threads, so anything they */
+/* share with the main thread needs to go through the lock */
+struct PRG_STATE {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int quit;
+    struct STATIC_PAGES *pages; /* read-only once the server starts */
+    struct RESULT_CACHE *cache; /* has its own lock */
+    struct ROM_STORE    *roms;  /* so does this */
+    struct METRICS   *metrics;  /* and this */
+    struct JOB_QUEUE    *jobs;  /* and this */
 };
 
-enum COMP_MODE { /* these must match the order in the html file */
-    DK_CHECK_SIZE,
-    DK_DECOMPRESS,
-    DK_COMPRESS,
-    DK_ERROR
+/* responses that never change are built once and reused */
+struct STATIC_PAGE {
+    struct MHD_Response *response;  /* the page itself */
+    struct MHD_Response *unchanged; /* 304 for a matching If-None-Match */
+    unsigned char *data;
+    char etag[20];
 };
+struct STATIC_PAGES {
+    struct STATIC_PAGE html;
+    struct MHD_Response *empty;     /* /ping, /quit */
+    struct MHD_Response *not_found;
+};
+
+#define POST_LIMIT (1 << 26)
+#define JOB_LIMIT  64 /* jobs kept track of at once */
 
 struct CINFO {
     struct MHD_PostProcessor *processor;
     unsigned char *input;
     size_t    input_size;
+    size_t    input_capacity;
+    size_t    input_hint;       /* Content-Length, if the client sent one */
     size_t decomp_offset;
+    uint64_t handle;            /* an earlier upload to use instead */
+    int have_file;              /* whether a file field was sent */
+    struct ROM *rom;
     enum DK_FORMAT comp_format; /* dkcomp.h */
     enum COMP_MODE comp_mode;
 };
@@ -110,22 +132,39 @@ static enum MHD_Result iterate_post (
         cinfo->decomp_offset = strtol(data, NULL, 10);
         return MHD_YES;
     }
+    else if (!strcmp(key, "handle")) {
+        cinfo->handle = strtoull(data, NULL, 16);
+        return MHD_YES;
+    }
     else if (!strcmp(key, "file")) {
-        unsigned char *buf;
-        if ((cinfo->input_size + size) > (1 << 26)) {
+        cinfo->have_file = 1;
+        if ((cinfo->input_size + size) > POST_LIMIT) {
             fprintf(stderr, "Error: Exceeded maximum allowed POST size.\n");
             free(cinfo->input);
             cinfo->input = NULL;
             return MHD_NO;
         }
-        buf = realloc(cinfo->input, cinfo->input_size + size);
-        if (buf == NULL) {
-            fprintf(stderr, "Error: Failed to allocate for data buffer.\n");
-            free(cinfo->input);
-            cinfo->input = NULL;
-            return MHD_NO;
+        /* the file is most of the request body, so the first chunk */
+        /* allocates for all of it using Content-Length. without that */
+        /* (or if it was wrong) the buffer grows geometrically instead */
+        if ((cinfo->input_size + size) > cinfo->input_capacity) {
+            size_t capacity = cinfo->input_capacity ? cinfo->input_capacity
+                            : cinfo->input_hint     ? cinfo->input_hint : (1 << 16);
+            unsigned char *buf;
+            while (capacity < cinfo->input_size + size)
+                capacity *= 2;
+            if (capacity > POST_LIMIT)
+                capacity = POST_LIMIT;
+            buf = realloc(cinfo->input, capacity);
+            if (buf == NULL) {
+                fprintf(stderr, "Error: Failed to allocate for data buffer.\n");
+                free(cinfo->input);
+                cinfo->input = NULL;
+                return MHD_NO;
+            }
+            cinfo->input = buf;
+            cinfo->input_capacity = capacity;
         }
-        cinfo->input = buf;
         memcpy(&cinfo->input[cinfo->input_size], data, size);
         cinfo->input_size += size;
         return MHD_YES;
@@ -135,19 +174,12 @@ static enum MHD_Result iterate_post (
 
 static enum MHD_Result respond_message (
     struct MHD_Connection *connection,
-    const char *msg_in,
+    const char *msg,
     int status_code
 ) {
     struct MHD_Response *response;
     int e;
-    size_t msg_size = strlen(msg_in);
-    char *msg = malloc(msg_size + 1);
-    if (msg == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for a message.\n");
-        return MHD_NO;
-    }
-    strcpy(msg, msg_in);
-    response = MHD_create_response_from_buffer(msg_size, msg, MHD_RESPMEM_MUST_FREE);
+    response = MHD_create_response_from_buffer(strlen(msg), (void*)msg, MHD_RESPMEM_MUST_COPY);
     if (response == NULL)
         return MHD_NO;
     e = MHD_queue_response(connection, status_code, response);
@@ -176,19 +208,266 @@ static enum MHD_Result respond_binary (
 }
 
 
-static enum MHD_Result respond_file (
+/* a quoted 64-bit hash is plenty for an ETag */
+static void make_etag (char *etag, unsigned char *data, size_t size) {
+    snprintf(etag, 20, "\"%016llx\"", (unsigned long long)server_hash(data, size, 0));
+}
+
+static int load_page (struct STATIC_PAGE *page, const char *filename) {
+    size_t size;
+    if (load_file(filename, &page->data, &size))
+        return 1;
+    make_etag(page->etag, page->data, size);
+    page->response  = MHD_create_response_from_buffer(size, page->data, MHD_RESPMEM_PERSISTENT);
+    page->unchanged = MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
+    if (page->response == NULL || page->unchanged == NULL)
+        return 1;
+    MHD_add_response_header(page->response,  MHD_HTTP_HEADER_CONTENT_TYPE, "text/html; charset=utf-8");
+    MHD_add_response_header(page->response,  MHD_HTTP_HEADER_ETAG, page->etag);
+    MHD_add_response_header(page->unchanged, MHD_HTTP_HEADER_ETAG, page->etag);
+    return 0;
+}
+
+static int load_pages (struct STATIC_PAGES *pages) {
+    static const char not_found[] =
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head>\n"
+        "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\" />"
+        "<title>404 - Not Found</title>\n"
+        "</head>\n"
+        "<body>\n"
+        "404 - Not Found\n"
+        "<br>\n"
+        "(<a href=\"index.html\">try here</a>)\n"
+        "</body>\n"
+        "</html>";
+
+    memset(pages, 0, sizeof(struct STATIC_PAGES));
+
+    /* the server can still do its job without the page */
+    if (load_page(&pages->html, "server.html"))
+        fprintf(stderr, "Failed to load our HTML file.\n");
+
+    pages->empty     = MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
+    pages->not_found = MHD_create_response_from_buffer(
+        sizeof(not_found)-1, (void*)not_found, MHD_RESPMEM_PERSISTENT
+    );
+    return pages->empty == NULL || pages->not_found == NULL;
+}
+
+static void free_pages (struct STATIC_PAGES *pages) {
+    if (pages->html.response  != NULL) MHD_destroy_response(pages->html.response);
+    if (pages->html.unchanged != NULL) MHD_destroy_response(pages->html.unchanged);
+    if (pages->empty          != NULL) MHD_destroy_response(pages->empty);
+    if (pages->not_found      != NULL) MHD_destroy_response(pages->not_found);
+    free(pages->html.data);
+}
+
+static enum MHD_Result respond_page (
+    struct MHD_Connection *connection,
+    struct STATIC_PAGE *page
+) {
+    const char *match;
+    if (page->response == NULL)
+        return respond_message(connection, "Failed to load our HTML file.", MHD_HTTP_INTERNAL_SERVER_ERROR);
+    match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+    if (match != NULL && strstr(match, page->etag) != NULL)
+        return MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, page->unchanged);
+    return MHD_queue_response(connection, MHD_HTTP_OK, page->response);
+}
+
+/* the part of the input a request works on */
+static void request_input (struct CINFO *cinfo, unsigned char **input, size_t *size) {
+    *input = cinfo->input;
+    *size  = cinfo->input_size;
+    if (cinfo->comp_mode != DK_COMPRESS) {
+        *input += cinfo->decomp_offset;
+        *size  -= cinfo->decomp_offset;
+    }
+}
+
+static enum MHD_Result respond_exec (
+    struct MHD_Connection *connection,
+    struct PRG_STATE *state,
+    struct CINFO *cinfo
+) {
+    struct CACHE_KEY key;
+    unsigned char *input, *data = NULL;
+    size_t input_size, size = 0;
+    int e;
+
+    /* identical requests are answered from the cache, */
+    /* only successful results are worth keeping */
+    request_input(cinfo, &input, &input_size);
+    key.hash   = server_hash(input, input_size, 0);
+    key.size   = input_size;
+    key.format = cinfo->comp_format;
+    key.mode   = cinfo->comp_mode;
+    if (!cache_get(state->cache, &key, &data, &size)) {
+        double start = metrics_now();
+        metrics_begin(state->metrics);
+        e = server_run(
+            cinfo->comp_format,
+            cinfo->comp_mode,
+            input,
+            input_size,
+            NULL,
+            &data,
+            &size
+        );
+        metrics_end(
+            state->metrics,
+            cinfo->comp_format,
+            cinfo->comp_mode,
+            metrics_now() - start,
+            input_size,
+            data != NULL ? size : 0,
+            e
+        );
+        if (e)
+            return respond_message(connection, dk_get_error(e), MHD_HTTP_INTERNAL_SERVER_ERROR);
+        cache_put(state->cache, &key, data, size);
+    }
+
+    /* send the response, either the size or binary data */
+    if (cinfo->comp_mode == DK_CHECK_SIZE) {
+        char msg[32];
+        snprintf(msg, 32, "Compressed size is %zd bytes.\n", size);
+        return respond_message(connection, msg, MHD_HTTP_OK);
+    }
+    return respond_binary(connection, data, size);
+}
+
+/* the same as /exec, but it runs in the background */
+static enum MHD_Result submit_job (
+    struct MHD_Connection *connection,
+    struct PRG_STATE *state,
+    struct CINFO *cinfo
+) {
+    struct JOB_REQUEST req;
+    unsigned long long id;
+    char msg[32];
+
+    req.format = cinfo->comp_format;
+    req.mode   = cinfo->comp_mode;
+    req.owned  = cinfo->rom == NULL ? cinfo->input : NULL;
+    req.rom    = cinfo->rom;
+    request_input(cinfo, &req.input, &req.size);
+
+    if (jobs_submit(state->jobs, &req, &id))
+        return respond_message(connection, "Too many jobs, try again later.", MHD_HTTP_SERVICE_UNAVAILABLE);
+
+    /* the job has the input now */
+    cinfo->input = NULL;
+    cinfo->rom   = NULL;
+    snprintf(msg, 32, "%llu", id);
+    return respond_message(connection, msg, MHD_HTTP_ACCEPTED);
+}
+
+static const char *job_states[] = {
+    [JOB_QUEUED   ] = "queued",
+    [JOB_RUNNING  ] = "running",
+    [JOB_DONE     ] = "done",
+    [JOB_FAILED   ] = "failed",
+    [JOB_CANCELLED] = "cancelled"
+};
+
+/* /jobs/<id>          status (or DELETE to cancel) */
+/* /jobs/<id>/result   output, once it has finished */
+/* /jobs/<id>/cancel   stop it */
+static enum MHD_Result respond_job (
+    struct MHD_Connection *connection,
+    struct PRG_STATE *state,
+    const char *path,
+    const char *method
+) {
+    struct JOB_STATUS status;
+    unsigned long long id;
+    char *end;
+
+    id = strtoull(path, &end, 10);
+    if (end == path)
+        return respond_message(connection, "Invalid job.", MHD_HTTP_BAD_REQUEST);
+
+    if (!strcmp(end, "/cancel") || (!*end && !strcmp(method, "DELETE"))) {
+        if (jobs_cancel(state->jobs, id))
+            return respond_message(connection, "Unknown job.", MHD_HTTP_NOT_FOUND);
+        return MHD_queue_response(connection, MHD_HTTP_OK, state->pages->empty);
+    }
+    else if (!strcmp(end, "/result")) {
+        unsigned char *data;
+        if (jobs_result(state->jobs, id, &status, &data))
+            return respond_message(connection, "Unknown job.", MHD_HTTP_NOT_FOUND);
+        if (status.state == JOB_QUEUED || status.state == JOB_RUNNING)
+            return respond_message(connection, "Job hasn't finished.", MHD_HTTP_CONFLICT);
+        if (status.error)
+            return respond_message(connection, dk_get_error(status.error), MHD_HTTP_INTERNAL_SERVER_ERROR);
+        if (data == NULL) {
+            char msg[32];
+            snprintf(msg, 32, "Compressed size is %zd bytes.\n", status.output_size);
+            return respond_message(connection, msg, MHD_HTTP_OK);
+        }
+        return respond_binary(connection, data, status.output_size);
+    }
+    else if (!*end) {
+        char msg[256];
+        if (jobs_status(state->jobs, id, &status))
+            return respond_message(connection, "Unknown job.", MHD_HTTP_NOT_FOUND);
+        snprintf(msg, 256,
+            "{\"id\":%llu,\"state\":\"%s\",\"done\":%zu,\"total\":%zu,\"error\":\"%s\"}",
+            id,
+            job_states[status.state],
+            status.done,
+            status.total,
+            status.error ? dk_get_error(status.error) : ""
+        );
+        return respond_message(connection, msg, MHD_HTTP_OK);
+    }
+    return MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, state->pages->not_found);
+}
+
+static enum MHD_Result respond_cache (
+    struct MHD_Connection *connection,
+    struct RESULT_CACHE *cache
+) {
+    struct CACHE_STATS stats;
+    char msg[256];
+    cache_stats(cache, &stats);
+    snprintf(msg, 256,
+        "hits %llu\n"
+        "misses %llu\n"
+        "entries %zu\n"
+        "bytes %zu\n"
+        "limit %zu\n",
+        stats.hits,
+        stats.misses,
+        stats.entries,
+        stats.bytes,
+        stats.limit
+    );
+    return respond_message(connection, msg, MHD_HTTP_OK);
+}
+
+static enum MHD_Result respond_metrics (
     struct MHD_Connection *connection,
-    char *filename
+    struct PRG_STATE *state
 ) {
     struct MHD_Response *response;
-    unsigned char *buf;
+    struct CACHE_STATS cache;
+    char *text;
     size_t size;
     int e;
-    if (load_file(filename, &buf, &size))
-        return respond_message(connection, "Failed to load our HTML file.", MHD_HTTP_INTERNAL_SERVER_ERROR);
-    response = MHD_create_response_from_buffer(size, buf, MHD_RESPMEM_MUST_FREE);
-    if (response == NULL)
+    cache_stats(state->cache, &cache);
+    text = metrics_text(state->metrics, state->cache != NULL ? &cache : NULL, &size);
+    if (text == NULL)
+        return respond_message(connection, dk_get_error(DK_ERROR_ALLOC), MHD_HTTP_INTERNAL_SERVER_ERROR);
+    response = MHD_create_response_from_buffer(size, text, MHD_RESPMEM_MUST_FREE);
+    if (response == NULL) {
+        free(text);
         return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; version=0.0.4; charset=utf-8");
     e = MHD_queue_response(connection, MHD_HTTP_OK, response);
     MHD_destroy_response(response);
     return e;
@@ -206,16 +485,32 @@ static enum MHD_Result http_response (
 ) {
     (void)version;
 
+    struct PRG_STATE *state = cls;
     int e = 0;
 
-    if (!strcmp(url, "/exec") && !strcmp(method, "POST")) {
+    if ((!strcmp(url, "/exec") || !strcmp(url, "/upload") || !strcmp(url, "/jobs"))
+    &&   !strcmp(method, "POST")) {
         /* on the first iteration we set up a processor and a */
         /* struct to hold all of our parameters */
         struct CINFO *cinfo = *con_cls;
         if (cinfo == NULL) {
+            const char *length;
             cinfo = calloc(1, sizeof(struct CINFO));
             if (cinfo == NULL)
                 return MHD_NO;
+
+            /* (the buffer is only allocated once a file arrives) */
+            length = MHD_lookup_connection_value(
+                connection,
+                MHD_HEADER_KIND,
+                MHD_HTTP_HEADER_CONTENT_LENGTH
+            );
+            if (length != NULL) {
+                cinfo->input_hint = strtoul(length, NULL, 10);
+                if (cinfo->input_hint > POST_LIMIT)
+                    cinfo->input_hint = POST_LIMIT;
+            }
+
             cinfo->processor = MHD_create_post_processor(
                 connection,
                 1 << 16,
@@ -244,75 +539,88 @@ static enum MHD_Result http_response (
         /* and if we make it this far we're done, so we can */
         /* process the data and determine the response */
 
-        unsigned char *data = NULL;
-        size_t size = 0;
+        metrics_request(state->metrics,
+            !strcmp(url, "/upload") ? ENDPOINT_UPLOAD :
+            !strcmp(url, "/jobs")   ? ENDPOINT_JOBS   : ENDPOINT_EXEC);
 
-        if (cinfo->comp_mode != DK_COMPRESS
-        &&  cinfo->decomp_offset >= cinfo->input_size) {
-            e = respond_message(connection, "Decompression offset is larger than input size.", MHD_HTTP_INTERNAL_SERVER_ERROR);
+        /* an upload is kept for later requests to refer to */
+        if (!strcmp(url, "/upload")) {
+            uint64_t handle;
+            if (cinfo->input == NULL) {
+                e = respond_message(connection, "No file was uploaded.", MHD_HTTP_BAD_REQUEST);
+            }
+            else if (rom_put(state->roms, cinfo->input, cinfo->input_size, &handle)) {
+                e = respond_message(connection, "Not enough room to store the file.", MHD_HTTP_SERVICE_UNAVAILABLE);
+            }
+            else {
+                char msg[20];
+                snprintf(msg, 20, "%016llx", (unsigned long long)handle);
+                e = respond_message(connection, msg, MHD_HTTP_OK);
+            }
+            cinfo->input = NULL; /* the store has it now */
         }
         else {
-            switch (cinfo->comp_mode) {
-                case DK_CHECK_SIZE: {
-                    e = dk_compressed_size_mem(
-                        cinfo->comp_format,
-                        cinfo->input      + cinfo->decomp_offset,
-                        cinfo->input_size - cinfo->decomp_offset,
-                        &size
-                    );
-                    break;
-                }
-                case DK_DECOMPRESS: {
-                    e = dk_decompress_mem_to_mem(
-                        cinfo->comp_format,
-                        &data, &size,
-                        cinfo->input      + cinfo->decomp_offset,
-                        cinfo->input_size - cinfo->decomp_offset
-                    );
-                    break;
-                }
-                case DK_COMPRESS: {
-                    e = dk_compress_mem_to_mem(
-                        cinfo->comp_format,
-                        &data, &size,
-                        cinfo->input,
-                        cinfo->input_size
-                    );
-                    break;
-                }
-                default: {
-                    respond_message(connection, "Invalid mode specified.", MHD_HTTP_INTERNAL_SERVER_ERROR);
-                    return 1;
-                }
+            /* an earlier upload can stand in for the file */
+            if (!cinfo->have_file && cinfo->handle
+            && (cinfo->rom = rom_get(state->roms, cinfo->handle)) != NULL) {
+                cinfo->input      = cinfo->rom->data;
+                cinfo->input_size = cinfo->rom->size;
             }
 
-            /* send the response, either an error or binary data */
-            if (e) {
-                e = respond_message(connection, dk_get_error(e), MHD_HTTP_INTERNAL_SERVER_ERROR);
+            /* an unknown handle tells the client to upload it again */
+            if (!cinfo->have_file && cinfo->handle && cinfo->rom == NULL) {
+                e = respond_message(connection, "Unknown handle.", MHD_HTTP_NOT_FOUND);
             }
-            else if (cinfo->comp_mode == DK_CHECK_SIZE) {
-                char msg[32];
-                snprintf(msg, 32, "Compressed size is %zd bytes.\n", size);
-                e = respond_message(connection, msg, MHD_HTTP_OK);
+            else if (cinfo->input == NULL) {
+                e = respond_message(connection, "No file was uploaded.", MHD_HTTP_BAD_REQUEST);
+            }
+            else if (cinfo->comp_mode == DK_ERROR) {
+                e = respond_message(connection, "Invalid mode specified.", MHD_HTTP_INTERNAL_SERVER_ERROR);
+            }
+            else if (cinfo->comp_mode != DK_COMPRESS
+            &&  cinfo->decomp_offset >= cinfo->input_size) {
+                e = respond_message(connection, "Decompression offset is larger than input size.", MHD_HTTP_INTERNAL_SERVER_ERROR);
+            }
+            else if (!strcmp(url, "/jobs")) {
+                e = submit_job(connection, state, cinfo);
             }
             else {
-                e = respond_binary(connection, data, size);
+                e = respond_exec(connection, state, cinfo);
             }
         }
 
         /* all done */
         MHD_destroy_post_processor(cinfo->processor);
-        free(cinfo->input);
+        if (cinfo->rom != NULL)
+            rom_release(state->roms, cinfo->rom);
+        else
+            free(cinfo->input);
         free(cinfo);
     }
+    else if (!strncmp(url, "/jobs/", 6)) {
+        metrics_request(state->metrics, ENDPOINT_JOBS);
+        e = respond_job(connection, state, url+6, method);
+    }
+    else if (!strcmp(url, "/cache")) {
+        metrics_request(state->metrics, ENDPOINT_CACHE);
+        e = respond_cache(connection, state->cache);
+    }
+    else if (!strcmp(url, "/metrics")) {
+        metrics_request(state->metrics, ENDPOINT_METRICS);
+        e = respond_metrics(connection, state);
+    }
     else if (!strcmp(url, "/ping")) {
-        e = respond_message(connection, "", MHD_HTTP_OK);
+        metrics_request(state->metrics, ENDPOINT_PING);
+        e = MHD_queue_response(connection, MHD_HTTP_OK, state->pages->empty);
     }
     else if (!strcmp(url, "/quit")) {
-        enum PRG_STATE *status = cls;
-        *status = PRG_QUIT;
-        e = respond_message(connection, "", MHD_HTTP_OK);
+        metrics_request(state->metrics, ENDPOINT_QUIT);
+        e = MHD_queue_response(connection, MHD_HTTP_OK, state->pages->empty);
         puts("Received quit command.");
+        pthread_mutex_lock(&state->lock);
+        state->quit = 1;
+        pthread_cond_signal(&state->cond);
+        pthread_mutex_unlock(&state->lock);
     }
     else if (
         !strcmp(url, "/")
@@ -320,24 +628,12 @@ static enum MHD_Result http_response (
     ||  !strcmp(url, "/index.html")
     ||  !strcmp(url, "/server.html")
     ) {
-        e = respond_file(connection, "server.html");
+        metrics_request(state->metrics, ENDPOINT_PAGE);
+        e = respond_page(connection, &state->pages->html);
     }
     else {
-        e = respond_message(connection,
-            "<!DOCTYPE html>\n"
-            "<html>\n"
-            "<head>\n"
-            "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\" />"
-            "<title>404 - Not Found</title>\n"
-            "</head>\n"
-            "<body>\n"
-            "404 - Not Found\n"
-            "<br>\n"
-            "(<a href=\"index.html\">try here</a>)\n"
-            "</body>\n"
-            "</html>",
-            404
-        );
+        metrics_request(state->metrics, ENDPOINT_OTHER);
+        e = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, state->pages->not_found);
     }
     return e;
 }
@@ -355,43 +651,91 @@ static void open_url (unsigned port) {
 }
 
 struct PRG_ARGS {
-    unsigned short  port;
-    unsigned short sleep;
+    unsigned short   port;
+    unsigned short threads;
+    size_t cache;
+    size_t roms;
+    unsigned short workers;
     int launch;
 };
 
 static int server_loop (struct PRG_ARGS *args) {
-    enum PRG_STATE status = PRG_RUNNING;
+    struct STATIC_PAGES pages;
+    struct PRG_STATE state;
+    struct MHD_Daemon *daemon;
+
+    if (load_pages(&pages)) {
+        puts("Failed to create static responses.");
+        free_pages(&pages);
+        return 1;
+    }
 
-    struct MHD_Daemon *daemon = MHD_start_daemon(
-        MHD_USE_SELECT_INTERNALLY
+    state.metrics = metrics_create();
+    state.roms    = rom_store_create(args->roms);
+    state.jobs    = NULL;
+    if (state.metrics == NULL || state.roms == NULL
+    || (state.jobs = jobs_create(args->workers, JOB_LIMIT, state.roms, state.metrics)) == NULL) {
+        puts("Failed to create server state.");
+        metrics_free(state.metrics);
+        rom_store_free(state.roms);
+        free_pages(&pages);
+        return 1;
+    }
+
+    /* carry on without one if it can't be created */
+    state.cache = NULL;
+    if (args->cache && (state.cache = cache_create(args->cache)) == NULL)
+        puts("Failed to create result cache.");
+
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init (&state.cond, NULL);
+    state.quit  = 0;
+    state.pages = &pages;
+
+    /* MHD picks the best polling method available (epoll on linux) */
+    /* and shares incoming connections between the worker threads */
+    daemon = MHD_start_daemon(
+        MHD_USE_AUTO
+      | MHD_USE_INTERNAL_POLLING_THREAD
       | MHD_USE_ERROR_LOG,
         args->port,
         NULL, NULL,
-        &http_response, &status,
+        &http_response, &state,
+        MHD_OPTION_THREAD_POOL_SIZE, (unsigned)args->threads,
         MHD_OPTION_END
     );
 
     if (daemon == NULL) {
         puts("Failed to start MHD Daemon.");
+        pthread_cond_destroy (&state.cond);
+        pthread_mutex_destroy(&state.lock);
+        jobs_free(state.jobs);
+        cache_free(state.cache);
+        rom_store_free(state.roms);
+        metrics_free(state.metrics);
+        free_pages(&pages);
         return 1;
     }
 
-    printf("Server active on 127.0.0.1:%u\n", args->port);
+    printf("Server active on 127.0.0.1:%u (%u threads)\n", args->port, args->threads);
 
     if (args->launch)
         open_url(args->port);
 
-    for (;;) {
-#if defined(__WIN32)
-    Sleep(args->sleep);
-#else
-    usleep(args->sleep);
-#endif
-        if (status == PRG_QUIT)
-            break;
-    }
+    /* sleep until someone asks us to quit */
+    pthread_mutex_lock(&state.lock);
+    while (!state.quit)
+        pthread_cond_wait(&state.cond, &state.lock);
+    pthread_mutex_unlock(&state.lock);
+
     MHD_stop_daemon(daemon);
+    pthread_cond_destroy (&state.cond);
+    pthread_mutex_destroy(&state.lock);
+    jobs_free(state.jobs); /* (before anything its workers use) */
+    cache_free(state.cache);
+    rom_store_free(state.roms);
+    metrics_free(state.metrics);
+    free_pages(&pages);
     return 0;
 }
 
@@ -402,18 +746,38 @@ static int parse_args (int argc, char *argv[], struct PRG_ARGS *args) {
             puts(
                 "dkcomp web interface\n\n"
                 "options:\n"
-                "  --nolaunch   ; don't automatically open the page\n"
-                "  --port  NUM  ; run server on specified port        (default: 1234)\n"
-                "  --sleep NUM  ; check for requests at this interval (default:  100)\n"
-                "  --help       ; display this help text"
+                "  --nolaunch     ; don't automatically open the page\n"
+                "  --port    NUM  ; run server on specified port     (default: 1234)\n"
+                "  --threads NUM  ; handle this many requests at once (default:    4)\n"
+                "  --cache   MiB  ; memory for storing results, 0 to disable (default:  64)\n"
+                "  --roms    MiB  ; memory for storing uploaded files        (default: 256)\n"
+                "  --workers NUM  ; run this many background jobs at once     (default:   2)\n"
+                "  --help         ; display this help text"
             );
             return 1;
         }
         else if (!strcmp(argv[i], "--port") && ++i < argc) {
             args->port = strtol(argv[i], NULL, 0);
         }
-        else if (!strcmp(argv[i], "--sleep") && ++i < argc) {
-            args->sleep = strtol(argv[i], NULL, 0);
+        else if (!strcmp(argv[i], "--threads") && ++i < argc) {
+            args->threads = strtol(argv[i], NULL, 0);
+            if (!args->threads || args->threads > 256) {
+                fprintf(stderr, "thread count should be between 1 and 256\n");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--cache") && ++i < argc) {
+            args->cache = (size_t)strtoul(argv[i], NULL, 0) << 20;
+        }
+        else if (!strcmp(argv[i], "--workers") && ++i < argc) {
+            args->workers = strtol(argv[i], NULL, 0);
+            if (!args->workers || args->workers > 256) {
+                fprintf(stderr, "worker count should be between 1 and 256\n");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--roms") && ++i < argc) {
+            args->roms = (size_t)strtoul(argv[i], NULL, 0) << 20;
         }
         else if (!strcmp(argv[i], "--nolaunch")) {
             args->launch = 0;
@@ -429,9 +793,12 @@ static int parse_args (int argc, char *argv[], struct PRG_ARGS *args) {
 int main (int argc, char *argv[]) {
 
     struct PRG_ARGS args;
-    args.port   = 1234;
-    args.sleep  = 100;
-    args.launch = 1;
+    args.port    = 1234;
+    args.threads = 4;
+    args.cache   =  64 << 20;
+    args.roms    = (size_t)256 << 20;
+    args.workers = 2;
+    args.launch  = 1;
 
     if (parse_args(argc, argv, &args) 
     ||  server_loop(&args))
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - web version backend */
+
+#ifndef DK_SERVER
+#define DK_SERVER
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum COMP_MODE { /* these must match the order in the html file */
+    DK_CHECK_SIZE,
+    DK_DECOMPRESS,
+    DK_COMPRESS,
+    DK_ERROR
+};
+
+/* xxHash64 */
+uint64_t server_hash (const unsigned char *data, size_t size, uint64_t seed);
+
+
+/* entries that get evicted least recently used first */
+struct LRU_NODE {
+    struct LRU_NODE *prev, *next;
+};
+
+
+/* Result cache (server_cache.c) */
+/* identical requests get the stored output instead of being run again */
+
+struct CACHE_KEY {
+    uint64_t hash; /* of the input the request operates on */
+    size_t   size; /* and its size */
+    int    format;
+    int      mode;
+};
+
+struct CACHE_STATS {
+    unsigned long long hits;
+    unsigned long long misses;
+    size_t entries;
+    size_t bytes;
+    size_t limit;
+};
+
+struct RESULT_CACHE;
+
+struct RESULT_CACHE *cache_create (size_t limit);
+void cache_free (struct RESULT_CACHE*);
+
+/* on a hit, *data is a copy for the caller to free (NULL if the */
+/* result has no data, like a size check) and 1 is returned     */
+int  cache_get (
+    struct RESULT_CACHE*,
+    const struct CACHE_KEY*,
+    unsigned char **data,
+    size_t *size
+);
+void cache_put (
+    struct RESULT_CACHE*,
+    const struct CACHE_KEY*,
+    const unsigned char *data,
+    size_t size
+);
+void cache_stats (struct RESULT_CACHE*, struct CACHE_STATS*);
+
+
+/* ROM store (server_cache.c) */
+/* lets a ROM be uploaded once and referred to by its hash afterwards */
+
+struct ROM {
+    struct LRU_NODE node; /* (must be first) */
+    struct ROM *chain;    /* next in bucket */
+    uint64_t handle;
+    unsigned char *data;
+    size_t size;
+    unsigned refs;        /* requests using it, it can't be evicted until 0 */
+};
+
+struct ROM_STORE;
+
+struct ROM_STORE *rom_store_create (size_t limit);
+void rom_store_free (struct ROM_STORE*);
+
+/* takes ownership of data, returns 1 if there's no room for it */
+int  rom_put (struct ROM_STORE*, unsigned char *data, size_t size, uint64_t *handle);
+
+/* NULL if the handle is unknown (or was evicted), */
+/* otherwise it must be released after use */
+struct ROM *rom_get (struct ROM_STORE*, uint64_t handle);
+void rom_release (struct ROM_STORE*, struct ROM*);
+
+
+/* Metrics (server_metrics.c) */
+
+enum ENDPOINT {
+    ENDPOINT_EXEC,
+    ENDPOINT_UPLOAD,
+    ENDPOINT_JOBS,
+    ENDPOINT_CACHE,
+    ENDPOINT_METRICS,
+    ENDPOINT_PING,
+    ENDPOINT_QUIT,
+    ENDPOINT_PAGE,
+    ENDPOINT_OTHER,
+    ENDPOINT_LIMIT
+};
+
+struct METRICS;
+
+struct METRICS *metrics_create (void);
+void metrics_free (struct METRICS*);
+
+double metrics_now (void); /* monotonic, in seconds */
+void metrics_request (struct METRICS*, enum ENDPOINT);
+
+/* a job runs between these two */
+void metrics_begin (struct METRICS*);
+void metrics_end (
+    struct METRICS*,
+    int format,
+    int mode,
+    double seconds,
+    size_t bytes_in,
+    size_t bytes_out,
+    int error
+);
+
+/* everything so far as a malloc'd string, cache may be NULL */
+char *metrics_text (
+    struct METRICS*,
+    const struct CACHE_STATS *cache,
+    size_t *size
+);
+
+
+/* Background jobs (server_jobs.c) */
+
+struct DK_OPTIONS;
+
+/* run a request directly, opt may be NULL */
+int server_run (
+    int format,
+    enum COMP_MODE mode,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *opt,
+    unsigned char **data,
+    size_t *size
+);
+
+struct JOB_REQUEST {
+    int format;
+    enum COMP_MODE mode;
+    unsigned char *input; /* what to work on */
+    size_t size;
+    unsigned char *owned; /* freed once the job is done with it */
+    struct ROM *rom;      /* or released back to the store */
+};
+
+enum JOB_STATE {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED
+};
+
+struct JOB_STATUS {
+    enum JOB_STATE state;
+    size_t done, total; /* progress, as reported by the compressor */
+    size_t output_size; /* (compressed size for a size check) */
+    int error;
+};
+
+struct JOB_QUEUE;
+
+/* limit is how many jobs to keep track of at once */
+struct JOB_QUEUE *jobs_create (
+    unsigned workers,
+    unsigned limit,
+    struct ROM_STORE*,
+    struct METRICS*
+);
+void jobs_free (struct JOB_QUEUE*);
+
+/* the job takes over the request's input on success, */
+/* returns 1 if it can't be queued right now          */
+int jobs_submit (struct JOB_QUEUE*, struct JOB_REQUEST*, unsigned long long *id);
+
+/* these return 1 for an unknown job */
+int jobs_status (struct JOB_QUEUE*, unsigned long long id, struct JOB_STATUS*);
+int jobs_cancel (struct JOB_QUEUE*, unsigned long long id);
+
+/* once a job has finished, this hands over its output (if any) */
+/* for the caller to free, and the job is forgotten */
+int jobs_result (
+    struct JOB_QUEUE*,
+    unsigned long long id,
+    struct JOB_STATUS*,
+    unsigned char **data
+);
+
+#endif
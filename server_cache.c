@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - web version backend (result cache and ROM store) */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "server.h"
+
+/* xxHash64 */
+
+#define P1 0x9E3779B185EBCA87ull
+#define P2 0xC2B2AE3D27D4EB4Full
+#define P3 0x165667B19E3779F9ull
+#define P4 0x85EBCA77C2B2AE63ull
+#define P5 0x27D4EB2F165667C5ull
+
+static uint64_t rotl (uint64_t v, int n) {
+    return (v << n) | (v >> (64 - n));
+}
+static uint64_t read64 (const unsigned char *p) {
+    uint64_t v = 0;
+    int i;
+    for (i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+static uint32_t read32 (const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint64_t round64 (uint64_t acc, uint64_t v) {
+    acc += v * P2;
+    acc  = rotl(acc, 31);
+    return acc * P1;
+}
+static uint64_t merge64 (uint64_t acc, uint64_t v) {
+    acc ^= round64(0, v);
+    return acc * P1 + P4;
+}
+
+uint64_t server_hash (const unsigned char *p, size_t size, uint64_t seed) {
+    const unsigned char *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        do {
+            v1 = round64(v1, read64(p));      p += 8;
+            v2 = round64(v2, read64(p));      p += 8;
+            v3 = round64(v3, read64(p));      p += 8;
+            v4 = round64(v4, read64(p));      p += 8;
+        } while (p <= end - 32);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    }
+    else {
+        h = seed + P5;
+    }
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= round64(0, read64(p));
+        h  = rotl(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h ^= read32(p) * P1;
+        h  = rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * P5;
+        h  = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33; h *= P2;
+    h ^= h >> 29; h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+
+/* both use a hash table for lookups, with a list */
+/* to find whatever was least recently used */
+
+#define BUCKETS 1024
+
+struct LRU {
+    struct LRU_NODE *head, *tail; /* most recent first */
+};
+
+static void lru_unlink (struct LRU *l, struct LRU_NODE *n) {
+    if (n->prev != NULL) n->prev->next = n->next; else l->head = n->next;
+    if (n->next != NULL) n->next->prev = n->prev; else l->tail = n->prev;
+}
+static void lru_push (struct LRU *l, struct LRU_NODE *n) {
+    n->prev = NULL;
+    n->next = l->head;
+    if (l->head != NULL)
+        l->head->prev = n;
+    l->head = n;
+    if (l->tail == NULL)
+        l->tail = n;
+}
+static void lru_touch (struct LRU *l, struct LRU_NODE *n) {
+    lru_unlink(l, n);
+    lru_push  (l, n);
+}
+
+
+
+/* Result cache */
+
+struct ENTRY {
+    struct LRU_NODE node; /* (must be first) */
+    struct CACHE_KEY key;
+    struct ENTRY *chain;  /* next in bucket */
+    unsigned char *data;
+    size_t size;
+};
+
+struct RESULT_CACHE {
+    pthread_mutex_t lock;
+    struct ENTRY *bucket[BUCKETS];
+    struct LRU lru;
+    struct CACHE_STATS stats;
+};
+
+/* how much an entry counts towards the limit */
+static size_t entry_cost (struct ENTRY *e) {
+    return sizeof(struct ENTRY) + (e->data != NULL ? e->size : 0);
+}
+
+static int key_equal (const struct CACHE_KEY *a, const struct CACHE_KEY *b) {
+    return a->hash   == b->hash
+        && a->size   == b->size
+        && a->format == b->format
+        && a->mode   == b->mode;
+}
+
+static struct ENTRY **find_slot (struct RESULT_CACHE *c, const struct CACHE_KEY *key) {
+    struct ENTRY **slot = &c->bucket[key->hash & (BUCKETS-1)];
+    while (*slot != NULL && !key_equal(&(*slot)->key, key))
+        slot = &(*slot)->chain;
+    return slot;
+}
+
+static void evict (struct RESULT_CACHE *c, struct ENTRY *e) {
+    struct ENTRY **slot = find_slot(c, &e->key);
+    *slot = e->chain;
+    lru_unlink(&c->lru, &e->node);
+    c->stats.entries--;
+    c->stats.bytes -= entry_cost(e);
+    free(e->data);
+    free(e);
+}
+
+struct RESULT_CACHE *cache_create (size_t limit) {
+    struct RESULT_CACHE *c = calloc(1, sizeof(struct RESULT_CACHE));
+    if (c == NULL)
+        return NULL;
+    pthread_mutex_init(&c->lock, NULL);
+    c->stats.limit = limit;
+    return c;
+}
+
+void cache_free (struct RESULT_CACHE *c) {
+    if (c == NULL)
+        return;
+    while (c->lru.head != NULL)
+        evict(c, (struct ENTRY*)c->lru.head);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+int cache_get (
+    struct RESULT_CACHE *c,
+    const struct CACHE_KEY *key,
+    unsigned char **data,
+    size_t *size
+) {
+    struct ENTRY *e;
+    int hit = 0;
+
+    if (c == NULL)
+        return 0;
+
+    pthread_mutex_lock(&c->lock);
+    if ((e = *find_slot(c, key)) != NULL) {
+        *data = NULL;
+        *size = e->size;
+        if (e->data == NULL || (*data = malloc(e->size ? e->size : 1)) != NULL) {
+            if (e->data != NULL)
+                memcpy(*data, e->data, e->size);
+            lru_touch(&c->lru, &e->node);
+            hit = 1;
+        }
+    }
+    if (hit) c->stats.hits++;
+    else     c->stats.misses++;
+    pthread_mutex_unlock(&c->lock);
+    return hit;
+}
+
+void cache_put (
+    struct RESULT_CACHE *c,
+    const struct CACHE_KEY *key,
+    const unsigned char *data,
+    size_t size
+) {
+    struct ENTRY *e, **slot;
+
+    if (c == NULL)
+        return;
+
+    /* don't bother if it would push everything else out */
+    if (sizeof(struct ENTRY) + (data != NULL ? size : 0) > c->stats.limit / 2)
+        return;
+
+    e = calloc(1, sizeof(struct ENTRY));
+    if (e == NULL)
+        return;
+    e->key  = *key;
+    e->size = size;
+    if (data != NULL) {
+        if ((e->data = malloc(size ? size : 1)) == NULL) {
+            free(e);
+            return;
+        }
+        memcpy(e->data, data, size);
+    }
+
+    pthread_mutex_lock(&c->lock);
+    slot = find_slot(c, key);
+    if (*slot != NULL) { /* someone else got here first */
+        pthread_mutex_unlock(&c->lock);
+        free(e->data);
+        free(e);
+        return;
+    }
+    *slot = e;
+    lru_push(&c->lru, &e->node);
+    c->stats.entries++;
+    c->stats.bytes += entry_cost(e);
+    while (c->stats.bytes > c->stats.limit && c->lru.tail != &e->node)
+        evict(c, (struct ENTRY*)c->lru.tail);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void cache_stats (struct RESULT_CACHE *c, struct CACHE_STATS *stats) {
+    memset(stats, 0, sizeof(struct CACHE_STATS));
+    if (c == NULL)
+        return;
+    pthread_mutex_lock(&c->lock);
+    *stats = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
+
+
+
+/* ROM store */
+/* uploads stay here until the memory they take is needed for */
+/* something else, but never while a request is still using them */
+
+struct ROM_STORE {
+    pthread_mutex_t lock;
+    struct ROM *bucket[BUCKETS];
+    struct LRU lru;
+    size_t bytes;
+    size_t limit;
+};
+
+static struct ROM **rom_slot (struct ROM_STORE *r, uint64_t handle) {
+    struct ROM **slot = &r->bucket[handle & (BUCKETS-1)];
+    while (*slot != NULL && (*slot)->handle != handle)
+        slot = &(*slot)->chain;
+    return slot;
+}
+
+static void rom_evict (struct ROM_STORE *r, struct ROM *rom) {
+    *rom_slot(r, rom->handle) = rom->chain;
+    lru_unlink(&r->lru, &rom->node);
+    r->bytes -= sizeof(struct ROM) + rom->size;
+    free(rom->data);
+    free(rom);
+}
+
+/* make room for this many more bytes, if possible */
+static int rom_make_room (struct ROM_STORE *r, size_t size) {
+    struct LRU_NODE *n = r->lru.tail;
+    while (r->bytes + size > r->limit && n != NULL) {
+        struct ROM *rom = (struct ROM*)n;
+        n = n->prev;
+        if (!rom->refs)
+            rom_evict(r, rom);
+    }
+    return r->bytes + size > r->limit;
+}
+
+struct ROM_STORE *rom_store_create (size_t limit) {
+    struct ROM_STORE *r = calloc(1, sizeof(struct ROM_STORE));
+    if (r == NULL)
+        return NULL;
+    pthread_mutex_init(&r->lock, NULL);
+    r->limit = limit;
+    return r;
+}
+
+void rom_store_free (struct ROM_STORE *r) {
+    if (r == NULL)
+        return;
+    while (r->lru.head != NULL)
+        rom_evict(r, (struct ROM*)r->lru.head);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
+
+int rom_put (struct ROM_STORE *r, unsigned char *data, size_t size, uint64_t *handle) {
+    struct ROM *rom;
+    unsigned char *d;
+
+    *handle = server_hash(data, size, 0);
+
+    pthread_mutex_lock(&r->lock);
+    if ((rom = *rom_slot(r, *handle)) != NULL) { /* already have it */
+        lru_touch(&r->lru, &rom->node);
+        pthread_mutex_unlock(&r->lock);
+        free(data);
+        return 0;
+    }
+    if (rom_make_room(r, sizeof(struct ROM) + size)
+    || (rom = calloc(1, sizeof(struct ROM))) == NULL) {
+        pthread_mutex_unlock(&r->lock);
+        free(data);
+        return 1;
+    }
+    /* the upload buffer may have been sized for the whole request */
+    if (size && (d = realloc(data, size)) != NULL)
+        data = d;
+    rom->handle = *handle;
+    rom->data   = data;
+    rom->size   = size;
+    *rom_slot(r, *handle) = rom; /* (making room may have moved the slot) */
+    lru_push(&r->lru, &rom->node);
+    r->bytes += sizeof(struct ROM) + size;
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+struct ROM *rom_get (struct ROM_STORE *r, uint64_t handle) {
+    struct ROM *rom;
+    pthread_mutex_lock(&r->lock);
+    if ((rom = *rom_slot(r, handle)) != NULL) {
+        rom->refs++;
+        lru_touch(&r->lru, &rom->node);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return rom;
+}
+
+void rom_release (struct ROM_STORE *r, struct ROM *rom) {
+    pthread_mutex_lock(&r->lock);
+    rom->refs--;
+    pthread_mutex_unlock(&r->lock);
+}
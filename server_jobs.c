@@ -0,0 +1,328 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - web version backend (background jobs) */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dkcomp.h>
+#include "server.h"
+
+int server_run (
+    int format,
+    enum COMP_MODE mode,
+    unsigned char *input,
+    size_t input_size,
+    const struct DK_OPTIONS *opt,
+    unsigned char **data,
+    size_t *size
+) {
+    switch (mode) {
+        case DK_CHECK_SIZE: {
+            return dk_compressed_size_mem(format, input, input_size, size);
+        }
+        case DK_DECOMPRESS: {
+            return dk_decompress_mem_to_mem(format, data, size, input, input_size);
+        }
+        case DK_COMPRESS: {
+            return dk_compress_mem_to_mem_opt(format, data, size, input, input_size, opt);
+        }
+        default: {
+            return DK_ERROR_INVALID;
+        }
+    }
+}
+
+
+
+/* jobs wait in a queue for one of the workers, then stay */
+/* around until their result is collected (or they get pushed */
+/* out by newer jobs) */
+
+struct JOB {
+    struct JOB *next;       /* all jobs, oldest first */
+    struct JOB *next_queued;
+    unsigned long long id;
+    struct JOB_REQUEST req;
+    struct JOB_STATUS status;
+    int cancel;           /* returned to the compressor by job_progress */
+    unsigned char *output;
+    struct JOB_QUEUE *queue;
+};
+
+struct JOB_QUEUE {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    struct JOB *jobs;
+    struct JOB *queued, **queued_tail;
+    unsigned count, limit;
+    unsigned long long next_id;
+    int stop;
+    struct ROM_STORE *roms;
+    struct METRICS   *metrics;
+    unsigned  workers;
+    pthread_t thread[];
+};
+
+static void release_input (struct JOB_QUEUE *q, struct JOB_REQUEST *req) {
+    if (req->rom != NULL)
+        rom_release(q->roms, req->rom);
+    free(req->owned);
+    req->rom   = NULL;
+    req->owned = NULL;
+}
+
+static void job_free (struct JOB_QUEUE *q, struct JOB *job) {
+    release_input(q, &job->req);
+    free(job->output);
+    free(job);
+}
+
+static struct JOB **find_job (struct JOB_QUEUE *q, unsigned long long id) {
+    struct JOB **slot = &q->jobs;
+    while (*slot != NULL && (*slot)->id != id)
+        slot = &(*slot)->next;
+    return slot;
+}
+
+static int finished (struct JOB *job) {
+    return job->status.state != JOB_QUEUED
+        && job->status.state != JOB_RUNNING;
+}
+
+/* called from the compressor's main loop, nonzero stops it */
+static int job_progress (void *data, size_t done, size_t total) {
+    struct JOB *job = data;
+    struct JOB_QUEUE *q = job->queue;
+    int cancel;
+    pthread_mutex_lock(&q->lock);
+    job->status.done  = done;
+    job->status.total = total;
+    cancel = job->cancel;
+    pthread_mutex_unlock(&q->lock);
+    return cancel;
+}
+
+static void *worker (void *arg) {
+    struct JOB_QUEUE *q = arg;
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        struct DK_OPTIONS opt;
+        struct JOB *job;
+        unsigned char *output = NULL;
+        size_t size = 0;
+        double start;
+        int e;
+
+        while (!q->stop && q->queued == NULL)
+            pthread_cond_wait(&q->cond, &q->lock);
+        if (q->stop)
+            break;
+
+        job = q->queued;
+        if ((q->queued = job->next_queued) == NULL)
+            q->queued_tail = &q->queued;
+        job->status.state = JOB_RUNNING;
+        pthread_mutex_unlock(&q->lock);
+
+        memset(&opt, 0, sizeof(struct DK_OPTIONS));
+        opt.progress      = job_progress;
+        opt.progress_data = job;
+        opt.poll_interval = 1024;
+
+        start = metrics_now();
+        metrics_begin(q->metrics);
+        e = server_run(
+            job->req.format,
+            job->req.mode,
+            job->req.input,
+            job->req.size,
+            &opt,
+            &output,
+            &size
+        );
+        metrics_end(
+            q->metrics,
+            job->req.format,
+            job->req.mode,
+            metrics_now() - start,
+            job->req.size,
+            output != NULL ? size : 0,
+            e
+        );
+
+        pthread_mutex_lock(&q->lock);
+        release_input(q, &job->req);
+        job->output             = output;
+        job->status.output_size = size;
+        job->status.error       = e;
+        job->status.state       = !e ? JOB_DONE
+                                : e == DK_ERROR_CANCELLED ? JOB_CANCELLED
+                                : JOB_FAILED;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+struct JOB_QUEUE *jobs_create (
+    unsigned workers,
+    unsigned limit,
+    struct ROM_STORE *roms,
+    struct METRICS *metrics
+) {
+    struct JOB_QUEUE *q;
+    unsigned i;
+
+    q = calloc(1, sizeof(struct JOB_QUEUE) + workers * sizeof(pthread_t));
+    if (q == NULL)
+        return NULL;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init (&q->cond, NULL);
+    q->queued_tail = &q->queued;
+    q->limit   = limit;
+    q->next_id = 1;
+    q->roms    = roms;
+    q->metrics = metrics;
+
+    for (i = 0; i < workers; i++) {
+        if (pthread_create(&q->thread[i], NULL, worker, q))
+            break;
+        q->workers++;
+    }
+    if (!q->workers) {
+        jobs_free(q);
+        return NULL;
+    }
+    return q;
+}
+
+void jobs_free (struct JOB_QUEUE *q) {
+    struct JOB *job;
+    unsigned i;
+    if (q == NULL)
+        return;
+
+    /* anything still running is told to stop */
+    pthread_mutex_lock(&q->lock);
+    for (job = q->jobs; job != NULL; job = job->next)
+        job->cancel = 1;
+    q->stop = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+
+    for (i = 0; i < q->workers; i++)
+        pthread_join(q->thread[i], NULL);
+
+    while ((job = q->jobs) != NULL) {
+        q->jobs = job->next;
+        job_free(q, job);
+    }
+    pthread_cond_destroy (&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+}
+
+int jobs_submit (
+    struct JOB_QUEUE *q,
+    struct JOB_REQUEST *req,
+    unsigned long long *id
+) {
+    struct JOB *job, *old, **slot;
+
+    if ((job = calloc(1, sizeof(struct JOB))) == NULL)
+        return 1;
+
+    pthread_mutex_lock(&q->lock);
+
+    /* make room by forgetting the oldest finished job */
+    if (q->count >= q->limit) {
+        for (slot = &q->jobs; *slot != NULL && !finished(*slot); slot = &(*slot)->next);
+        if (*slot == NULL) {
+            pthread_mutex_unlock(&q->lock);
+            free(job);
+            return 1;
+        }
+        old   = *slot;
+        *slot = old->next;
+        q->count--;
+        job_free(q, old);
+    }
+
+    job->id    = q->next_id++;
+    job->req   = *req;
+    job->queue = q;
+    job->status.state = JOB_QUEUED;
+    job->status.total = req->size;
+
+    for (slot = &q->jobs; *slot != NULL; slot = &(*slot)->next);
+    *slot = job;
+    *q->queued_tail = job;
+    q->queued_tail  = &job->next_queued;
+    q->count++;
+    *id = job->id;
+
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+
+    /* the job owns the input now */
+    req->owned = NULL;
+    req->rom   = NULL;
+    return 0;
+}
+
+int jobs_status (struct JOB_QUEUE *q, unsigned long long id, struct JOB_STATUS *status) {
+    struct JOB *job;
+    pthread_mutex_lock(&q->lock);
+    if ((job = *find_job(q, id)) != NULL)
+        *status = job->status;
+    pthread_mutex_unlock(&q->lock);
+    return job == NULL;
+}
+
+int jobs_result (
+    struct JOB_QUEUE *q,
+    unsigned long long id,
+    struct JOB_STATUS *status,
+    unsigned char **data
+) {
+    struct JOB *job, **slot;
+    pthread_mutex_lock(&q->lock);
+    slot = find_job(q, id);
+    if ((job = *slot) == NULL) {
+        pthread_mutex_unlock(&q->lock);
+        return 1;
+    }
+    *status = job->status;
+    *data   = NULL;
+
+    /* collecting a result is the last thing anyone needs from a job */
+    if (finished(job)) {
+        *data = job->output;
+        job->output = NULL;
+        *slot = job->next;
+        q->count--;
+        job_free(q, job);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+int jobs_cancel (struct JOB_QUEUE *q, unsigned long long id) {
+    struct JOB *job, **slot;
+    pthread_mutex_lock(&q->lock);
+    if ((job = *find_job(q, id)) != NULL) {
+        job->cancel = 1;
+
+        /* nobody has picked it up yet, so it can finish right away */
+        if (job->status.state == JOB_QUEUED) {
+            for (slot = &q->queued; *slot != job; slot = &(*slot)->next_queued);
+            if ((*slot = job->next_queued) == NULL)
+                q->queued_tail = slot;
+            release_input(q, &job->req);
+            job->status.state = JOB_CANCELLED;
+            job->status.error = DK_ERROR_CANCELLED;
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job == NULL;
+}
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Kingizor
+ * dkcomp library - web version backend (metrics) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include <dkcomp.h>
+#include "server.h"
+
+/* request latency buckets in seconds, the last one is +Inf */
+static const double bounds[] = {
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30
+};
+#define BOUNDS (sizeof(bounds) / sizeof(bounds[0]))
+#define MODES 3
+
+static const char *format_names[COMP_LIMIT] = {
+    [BD_COMP        ] = "bd",
+    [SD_COMP        ] = "sd",
+    [DKCCHR_COMP    ] = "dkcchr",
+    [DKCGBC_COMP    ] = "dkcgbc",
+    [DKL_COMP       ] = "dkl",
+    [GBA_LZ77_COMP  ] = "gba_lz77",
+    [GBA_HUFF20_COMP] = "gba_huff20",
+    [GBA_RLE_COMP   ] = "gba_rle",
+    [GBA_HUFF50_COMP] = "gba_huff50",
+    [GBA_HUFF60_COMP] = "gba_huff60",
+    [GBA_COMP       ] = "gba",
+    [GB_PRINTER_COMP] = "gb_printer"
+};
+static const char *mode_names[MODES] = {
+    "size", "decompress", "compress"
+};
+static const char *endpoint_names[ENDPOINT_LIMIT] = {
+    [ENDPOINT_EXEC   ] = "exec",
+    [ENDPOINT_UPLOAD ] = "upload",
+    [ENDPOINT_JOBS   ] = "jobs",
+    [ENDPOINT_CACHE  ] = "cache",
+    [ENDPOINT_METRICS] = "metrics",
+    [ENDPOINT_PING   ] = "ping",
+    [ENDPOINT_QUIT   ] = "quit",
+    [ENDPOINT_PAGE   ] = "page",
+    [ENDPOINT_OTHER  ] = "other"
+};
+
+struct HISTOGRAM {
+    unsigned long long bucket[BOUNDS+1];
+    unsigned long long count;
+    double sum;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+};
+
+struct METRICS {
+    pthread_mutex_t lock;
+    unsigned long long requests[ENDPOINT_LIMIT];
+    unsigned long long errors[DK_ERROR_LIMIT];
+    unsigned in_flight;
+    struct HISTOGRAM job[COMP_LIMIT][MODES];
+};
+
+double metrics_now (void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+struct METRICS *metrics_create (void) {
+    struct METRICS *m = calloc(1, sizeof(struct METRICS));
+    if (m == NULL)
+        return NULL;
+    pthread_mutex_init(&m->lock, NULL);
+    return m;
+}
+
+void metrics_free (struct METRICS *m) {
+    if (m == NULL)
+        return;
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+}
+
+void metrics_request (struct METRICS *m, enum ENDPOINT endpoint) {
+    pthread_mutex_lock(&m->lock);
+    m->requests[endpoint]++;
+    pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_begin (struct METRICS *m) {
+    pthread_mutex_lock(&m->lock);
+    m->in_flight++;
+    pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_end (
+    struct METRICS *m,
+    int format,
+    int mode,
+    double seconds,
+    size_t bytes_in,
+    size_t bytes_out,
+    int error
+) {
+    pthread_mutex_lock(&m->lock);
+    m->in_flight--;
+    if (error > 0 && error < DK_ERROR_LIMIT)
+        m->errors[error]++;
+    if (format >= 0 && format < COMP_LIMIT && mode >= 0 && mode < MODES) {
+        struct HISTOGRAM *h = &m->job[format][mode];
+        size_t i = 0;
+        while (i < BOUNDS && seconds > bounds[i])
+            i++;
+        h->bucket[i]++;
+        h->count++;
+        h->sum += seconds;
+        h->bytes_in  += bytes_in;
+        h->bytes_out += error ? 0 : bytes_out;
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+
+
+/* text output */
+
+struct TEXT {
+    char  *data;
+    size_t size;
+    size_t capacity;
+    int error;
+};
+
+static void text_printf (struct TEXT *t, const char *fmt, ...) {
+    va_list args;
+    int n;
+    if (t->error)
+        return;
+    for (;;) {
+        va_start(args, fmt);
+        n = vsnprintf(t->data + t->size, t->capacity - t->size, fmt, args);
+        va_end(args);
+        if (n < 0) {
+            t->error = 1;
+            return;
+        }
+        if ((size_t)n < t->capacity - t->size)
+            break;
+        {
+            size_t capacity = t->capacity * 2 + n;
+            char *data = realloc(t->data, capacity);
+            if (data == NULL) {
+                t->error = 1;
+                return;
+            }
+            t->data = data;
+            t->capacity = capacity;
+        }
+    }
+    t->size += n;
+}
+
+/* Prometheus text exposition format */
+char *metrics_text (
+    struct METRICS *m,
+    const struct CACHE_STATS *cache,
+    size_t *size
+) {
+    struct METRICS copy;
+    struct TEXT t = { NULL, 0, 0, 0 };
+    size_t i, f, md;
+
+    /* take a snapshot so the lock isn't held while formatting */
+    pthread_mutex_lock(&m->lock);
+    memcpy(&copy, m, sizeof(struct METRICS));
+    pthread_mutex_unlock(&m->lock);
+
+    if ((t.data = malloc(t.capacity = 1 << 14)) == NULL)
+        return NULL;
+
+    text_printf(&t, "# HELP dkcomp_requests_total Requests handled, by endpoint.\n");
+    text_printf(&t, "# TYPE dkcomp_requests_total counter\n");
+    for (i = 0; i < ENDPOINT_LIMIT; i++)
+        text_printf(&t, "dkcomp_requests_total{endpoint=\"%s\"} %llu\n",
+            endpoint_names[i], copy.requests[i]);
+
+    text_printf(&t, "# HELP dkcomp_jobs_in_flight Compression jobs currently running.\n");
+    text_printf(&t, "# TYPE dkcomp_jobs_in_flight gauge\n");
+    text_printf(&t, "dkcomp_jobs_in_flight %u\n", copy.in_flight);
+
+    text_printf(&t, "# HELP dkcomp_job_seconds Time taken by compression jobs.\n");
+    text_printf(&t, "# TYPE dkcomp_job_seconds histogram\n");
+    for (f = 0; f < COMP_LIMIT; f++)
+    for (md = 0; md < MODES; md++) {
+        struct HISTOGRAM *h = &copy.job[f][md];
+        unsigned long long total = 0;
+        if (!h->count)
+            continue;
+        for (i = 0; i <= BOUNDS; i++) {
+            total += h->bucket[i];
+            if (i < BOUNDS)
+                text_printf(&t, "dkcomp_job_seconds_bucket{format=\"%s\",mode=\"%s\",le=\"%g\"} %llu\n",
+                    format_names[f], mode_names[md], bounds[i], total);
+            else
+                text_printf(&t, "dkcomp_job_seconds_bucket{format=\"%s\",mode=\"%s\",le=\"+Inf\"} %llu\n",
+                    format_names[f], mode_names[md], total);
+        }
+        text_printf(&t, "dkcomp_job_seconds_sum{format=\"%s\",mode=\"%s\"} %.6f\n",
+            format_names[f], mode_names[md], h->sum);
+        text_printf(&t, "dkcomp_job_seconds_count{format=\"%s\",mode=\"%s\"} %llu\n",
+            format_names[f], mode_names[md], h->count);
+    }
+
+    text_printf(&t, "# HELP dkcomp_job_bytes_in_total Input bytes given to compression jobs.\n");
+    text_printf(&t, "# TYPE dkcomp_job_bytes_in_total counter\n");
+    for (f = 0; f < COMP_LIMIT; f++)
+    for (md = 0; md < MODES; md++)
+        if (copy.job[f][md].count)
+            text_printf(&t, "dkcomp_job_bytes_in_total{format=\"%s\",mode=\"%s\"} %llu\n",
+                format_names[f], mode_names[md], copy.job[f][md].bytes_in);
+
+    text_printf(&t, "# HELP dkcomp_job_bytes_out_total Output bytes produced by compression jobs.\n");
+    text_printf(&t, "# TYPE dkcomp_job_bytes_out_total counter\n");
+    for (f = 0; f < COMP_LIMIT; f++)
+    for (md = 0; md < MODES; md++)
+        if (copy.job[f][md].count)
+            text_printf(&t, "dkcomp_job_bytes_out_total{format=\"%s\",mode=\"%s\"} %llu\n",
+                format_names[f], mode_names[md], copy.job[f][md].bytes_out);
+
+    text_printf(&t, "# HELP dkcomp_job_errors_total Failed compression jobs, by error code.\n");
+    text_printf(&t, "# TYPE dkcomp_job_errors_total counter\n");
+    for (i = 1; i < DK_ERROR_LIMIT; i++)
+        if (copy.errors[i])
+            text_printf(&t, "dkcomp_job_errors_total{code=\"%zu\"} %llu\n", i, copy.errors[i]);
+
+    if (cache != NULL) {
+        text_printf(&t, "# TYPE dkcomp_cache_hits_total counter\n");
+        text_printf(&t, "dkcomp_cache_hits_total %llu\n", cache->hits);
+        text_printf(&t, "# TYPE dkcomp_cache_misses_total counter\n");
+        text_printf(&t, "dkcomp_cache_misses_total %llu\n", cache->misses);
+        text_printf(&t, "# TYPE dkcomp_cache_bytes gauge\n");
+        text_printf(&t, "dkcomp_cache_bytes %zu\n", cache->bytes);
+    }
+
+    if (t.error) {
+        free(t.data);
+        return NULL;
+    }
+    *size = t.size;
+    return t.data;
+}
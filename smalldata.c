@@ -118,6 +118,7 @@ static int  main_decompress (struct COMPRESSOR *sd) {
                 return DK_ERROR_SD_BAD_EXIT;
         }
 
+        stats_case(sd, mode, count*2);
         while (count--) {
             if (modify_word(sd, addr++, val))
                 return DK_ERROR_OOB_OUTPUT_W;
@@ -131,6 +132,37 @@ static int  main_decompress (struct COMPRESSOR *sd) {
     return 0;
 }
 
+/* the header holds the output size in words */
+int sd_size (struct COMPRESSOR *sd, size_t *size) {
+    int words;
+    if ((words = read_word(sd, sd->in.pos + 1)) < 0)
+        return DK_ERROR_OOB_INPUT;
+    *size = words << 1;
+    return 0;
+}
+
+/* only the lower bits of the first byte select routines, and the  */
+/* output can't be empty or larger than 64 KiB. the routines that  */
+/* run each need a minimum number of bits to reach their exits.   */
+int sd_probe (struct COMPRESSOR *sd) {
+    unsigned bits = 8+18; /* (fourth sub and the main routine) */
+    int subs, words, i;
+
+    if (sd->in.length < 3)
+        return 0;
+    subs  = sd->in.data[0];
+    words = sd->in.data[1] | (sd->in.data[2] << 8);
+    if ((subs & ~7) || !words || words > 0x8000)
+        return 0;
+
+    for (i = 0; i < 3; i++)
+        if (subs & (1 << i))
+            bits += 8;
+    if (sd->in.length < 3 + (bits+7)/8)
+        return 0;
+    return 20;
+}
+
 int sd_decompress (struct COMPRESSOR *sd) {
 
     int i, subs;
@@ -263,6 +295,10 @@ static int encode_main (struct COMPRESSOR *sd) {
         int LC;
         int w1;
 
+        /* (positions are always even here) */
+        if (dk_poll(sd, i >> 1, sd->in.length >> 1))
+            return DK_ERROR_CANCELLED;
+
         /* Read current word */
         if ((w1 = read_word(sd, i)) < 0)
             return DK_ERROR_OOB_INPUT;
@@ -308,12 +344,14 @@ static int encode_main (struct COMPRESSOR *sd) {
         if (!mode) { /* Single */
             if ((e = write_bits(sd, 12, val)))
                 return e;
+            stats_case(sd, mode, 2);
             i += 2;
         }
         else { /* Loop */
             int LS = (mode == 1) ? 6 : 4;
             if ((e = write_bits(sd, 12+LS, (val << LS) | LC)))
                 return e;
+            stats_case(sd, mode, LC*2);
             i += LC*2;
         }
         }
@@ -329,6 +367,7 @@ static int encode_main (struct COMPRESSOR *sd) {
 int sd_compress (struct COMPRESSOR *sd) {
 
     int i;
+    double t = stats_start(sd);
     enum DK_ERROR e;
 
     /* output size (i.e. word count) */
@@ -348,10 +387,12 @@ int sd_compress (struct COMPRESSOR *sd) {
     /* the fourth subroutine is mandatory (1C00) */
     if (encode_subs(sd, 0x1C, 15))
         return DK_ERROR_OOB_OUTPUT_W;
+    stats_phase(sd, DK_PHASE_SETUP, &t);
 
     /* The main loop (03FF) */
     if ((e = encode_main(sd)))
         return e;
+    stats_phase(sd, DK_PHASE_EMIT, &t);
 
     if (sd->out.bitpos && sd->out.pos < sd->out.limit)
         sd->out.pos++;